@@ -0,0 +1,228 @@
+"""ctypes bindings for the emulator's C API (src/capi.h).
+
+The library is found through the GAMEBOY_LIB environment variable, or next to
+this file as GameboyApi.dll (Windows) or libGameboyApi.so.
+
+Observations are written straight into numpy arrays by the emulator, already
+converted and downsampled if set_observation asked for it, and VectorEnv steps
+every instance with one call into the library. RAM can be viewed in place.
+"""
+
+import ctypes
+import os
+import sys
+
+import numpy as np
+
+SCREEN_WIDTH = 160
+SCREEN_HEIGHT = 144
+SCREEN_SHAPE = (SCREEN_HEIGHT, SCREEN_WIDTH)
+
+OBS_SHADE = 0
+OBS_GRAY = 1
+HRAM_SIZE = 127
+
+RIGHT = 1 << 0
+LEFT = 1 << 1
+UP = 1 << 2
+DOWN = 1 << 3
+A = 1 << 4
+B = 1 << 5
+SELECT = 1 << 6
+START = 1 << 7
+
+_u8p = ctypes.POINTER(ctypes.c_uint8)
+
+
+def _load_library():
+    path = os.environ.get("GAMEBOY_LIB")
+    if path is None:
+        name = "GameboyApi.dll" if sys.platform == "win32" else "libGameboyApi.so"
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+
+    lib = ctypes.CDLL(path)
+
+    def fn(name, restype, *argtypes):
+        f = getattr(lib, name)
+        f.restype = restype
+        f.argtypes = argtypes
+
+    fn("gb_rom_load", ctypes.c_void_p, ctypes.c_char_p)
+    fn("gb_rom_free", None, ctypes.c_void_p)
+    fn("gb_create", ctypes.c_void_p, ctypes.c_void_p)
+    fn("gb_fork", ctypes.c_void_p, ctypes.c_void_p)
+    fn("gb_destroy", None, ctypes.c_void_p)
+    fn("gb_set_observation", ctypes.c_int, ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32)
+    fn("gb_step", None, ctypes.c_void_p, ctypes.c_uint8, ctypes.c_uint32, _u8p)
+    fn("gb_run_cycles", None, ctypes.c_void_p, ctypes.c_uint32, _u8p)
+    fn("gb_run_until_pc", ctypes.c_int, ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint32, _u8p)
+    fn("gb_run_until_write", ctypes.c_int, ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint32, _u8p)
+    fn("gb_run_until_scanline", ctypes.c_int, ctypes.c_void_p, ctypes.c_uint8, ctypes.c_uint32, _u8p)
+    fn("gb_read_memory", None, ctypes.c_void_p, ctypes.c_uint16, _u8p, ctypes.c_uint32)
+    fn("gb_wram_view", ctypes.c_uint32, ctypes.c_void_p, ctypes.POINTER(_u8p), ctypes.c_uint32)
+    fn("gb_hram_view", _u8p, ctypes.c_void_p)
+    fn("gb_frame_count", ctypes.c_uint32, ctypes.c_void_p)
+    fn("gb_state_size", ctypes.c_size_t, ctypes.c_void_p)
+    fn("gb_save_state", ctypes.c_size_t, ctypes.c_void_p, _u8p, ctypes.c_size_t)
+    fn("gb_load_state", ctypes.c_int, ctypes.c_void_p, _u8p, ctypes.c_size_t)
+    fn("gb_pool_create", ctypes.c_void_p, ctypes.c_uint32)
+    fn("gb_pool_destroy", None, ctypes.c_void_p)
+    fn("gb_step_batch", None, ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p), ctypes.c_uint32,
+       _u8p, ctypes.c_uint32, _u8p, ctypes.c_size_t)
+    return lib
+
+
+_lib = _load_library()
+
+
+def _ptr(array):
+    return array.ctypes.data_as(_u8p)
+
+
+def _view(pointer, size):
+    array = np.ctypeslib.as_array(pointer, shape=(size,))
+    array.flags.writeable = False
+    return array
+
+
+def observation_shape(scale=1):
+    return (SCREEN_HEIGHT // scale, SCREEN_WIDTH // scale)
+
+
+class Rom:
+    """A memory-mapped ROM shared by every instance created from it."""
+
+    def __init__(self, path):
+        self._handle = _lib.gb_rom_load(os.fsencode(path))
+        if not self._handle:
+            raise IOError("could not load ROM %s" % path)
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            _lib.gb_rom_free(self._handle)
+            self._handle = None
+
+
+class Gameboy:
+    def __init__(self, rom, _handle=None):
+        self._handle = _handle if _handle is not None else _lib.gb_create(rom._handle)
+        self._shape = SCREEN_SHAPE
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            _lib.gb_destroy(self._handle)
+            self._handle = None
+
+    def set_observation(self, format=OBS_SHADE, scale=1):
+        """Renders shades 0-3 (OBS_SHADE) or grayscale 255-0 (OBS_GRAY),
+        averaged over scale x scale blocks for a scale of 2 or 4."""
+        if not _lib.gb_set_observation(self._handle, format, scale):
+            raise ValueError("unsupported observation format %d or scale %d" % (format, scale))
+        self._shape = observation_shape(scale)
+
+    @property
+    def observation_shape(self):
+        return self._shape
+
+    def step(self, buttons=0, frames=1, screen=None):
+        """Holds buttons for frames frames and returns the last one rendered,
+        into screen if given. Pass screen=False to skip rendering."""
+        if screen is False:
+            _lib.gb_step(self._handle, buttons, frames, None)
+            return None
+        if screen is None:
+            screen = np.empty(self._shape, dtype=np.uint8)
+        assert screen.dtype == np.uint8 and screen.flags.c_contiguous and screen.size == self._shape[0] * self._shape[1]
+        _lib.gb_step(self._handle, buttons, frames, _ptr(screen))
+        return screen
+
+    # Finer stepping with the buttons of the last step held. These may stop part
+    # way through a frame and the next call of any of them, or step, carries
+    # on from there. Lines drawn meanwhile go into screen if given.
+    def _screen(self, screen):
+        if screen is None:
+            return None
+        assert screen.dtype == np.uint8 and screen.flags.c_contiguous and screen.size == self._shape[0] * self._shape[1]
+        return _ptr(screen)
+
+    def run_cycles(self, cycles, screen=None):
+        _lib.gb_run_cycles(self._handle, cycles, self._screen(screen))
+
+    def run_until_pc(self, pc, max_frames=1, screen=None):
+        """True if pc was reached before max_frames frames ended."""
+        return bool(_lib.gb_run_until_pc(self._handle, pc, max_frames, self._screen(screen)))
+
+    def run_until_write(self, addr, max_frames=1, screen=None):
+        return bool(_lib.gb_run_until_write(self._handle, addr, max_frames, self._screen(screen)))
+
+    def run_until_scanline(self, line, max_frames=1, screen=None):
+        return bool(_lib.gb_run_until_scanline(self._handle, line, max_frames, self._screen(screen)))
+
+    def read_memory(self, addr, size=1):
+        out = np.empty(size, dtype=np.uint8)
+        _lib.gb_read_memory(self._handle, addr, _ptr(out), size)
+        return out
+
+    def wram(self):
+        """Read-only views of work RAM (C000 - DFFF), one per page. Pages are
+        shared copy-on-write between forks, so the views are only valid until
+        this instance is next stepped, loaded or forked."""
+        pages = (_u8p * 16)()
+        size = _lib.gb_wram_view(self._handle, pages, len(pages))
+        return [_view(pages[i], size) for i in range(0x2000 // size)]
+
+    def hram(self):
+        """A read-only view of high RAM (FF80 - FFFE), valid as for wram."""
+        return _view(_lib.gb_hram_view(self._handle), HRAM_SIZE)
+
+    @property
+    def frame(self):
+        return _lib.gb_frame_count(self._handle)
+
+    def save_state(self):
+        buffer = np.empty(_lib.gb_state_size(self._handle), dtype=np.uint8)
+        if _lib.gb_save_state(self._handle, _ptr(buffer), buffer.size) == 0:
+            raise RuntimeError("could not save state")
+        return buffer.tobytes()
+
+    def load_state(self, state):
+        buffer = np.frombuffer(state, dtype=np.uint8).copy()
+        if not _lib.gb_load_state(self._handle, _ptr(buffer), buffer.size):
+            raise ValueError("state does not match this ROM or version")
+
+    def fork(self):
+        """A copy of this instance. Memory is shared copy-on-write."""
+        fork = Gameboy(None, _handle=_lib.gb_fork(self._handle))
+        fork._shape = self._shape
+        return fork
+
+
+class VectorEnv:
+    """count instances stepped together across a thread pool, rendering the
+    observation format and scale set on every instance."""
+
+    def __init__(self, rom, count, threads=0, format=OBS_SHADE, scale=1):
+        self.instances = [Gameboy(rom) for _ in range(count)]
+        for instance in self.instances:
+            instance.set_observation(format, scale)
+        self._handles = (ctypes.c_void_p * count)(*[g._handle for g in self.instances])
+        self._pool = _lib.gb_pool_create(threads)
+        self.screens = np.zeros((count,) + observation_shape(scale), dtype=np.uint8)
+
+    def __del__(self):
+        if getattr(self, "_pool", None):
+            _lib.gb_pool_destroy(self._pool)
+            self._pool = None
+
+    def __len__(self):
+        return len(self.instances)
+
+    def step(self, buttons, frames=1, render=True):
+        """Steps every instance, instance i holding buttons[i]. Returns the
+        screens array, which is reused by the next call."""
+        buttons = np.ascontiguousarray(buttons, dtype=np.uint8)
+        assert buttons.shape == (len(self),)
+        screens = _ptr(self.screens) if render else None
+        _lib.gb_step_batch(self._pool, self._handles, len(self), _ptr(buttons), frames,
+                           screens, self.screens[0].size)
+        return self.screens
@@ -0,0 +1,66 @@
+#include "stdafx.h"
+#include "SdlAudio.h"
+#include "audioring.h"
+
+static const int SAMPLE_RATE = 48000;
+static const u16 DEVICE_SAMPLES = 512;
+
+// about 170ms at 48kHz
+static const u32 RING_FRAMES = 8192;
+
+SdlAudio::SdlAudio()
+    : _device(0)
+{
+    _last[0] = 0;
+    _last[1] = 0;
+
+    SDL_InitSubSystem(SDL_INIT_AUDIO);
+
+    SDL_AudioSpec want;
+    memset(&want, 0, sizeof(want));
+    want.freq = SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 2;
+    want.samples = DEVICE_SAMPLES;
+    want.callback = &SdlAudio::Callback;
+    want.userdata = this;
+
+    SDL_AudioSpec have;
+    _device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (_device == 0)
+    {
+        return;
+    }
+
+    _ring = std::make_unique<AudioRing>(RING_FRAMES, have.freq);
+    SDL_PauseAudioDevice(_device, 0);
+}
+
+SdlAudio::~SdlAudio()
+{
+    if (_device != 0)
+    {
+        SDL_CloseAudioDevice(_device);
+    }
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+void SDLCALL SdlAudio::Callback(void* userdata, Uint8* stream, int len)
+{
+    SdlAudio* audio = (SdlAudio*)userdata;
+    i16* samples = (i16*)stream;
+    u32 frames = (u32)len / (2 * sizeof(i16));
+
+    u32 read = audio->_ring->Read(samples, frames);
+    if (read > 0)
+    {
+        audio->_last[0] = samples[(read - 1) * 2 + 0];
+        audio->_last[1] = samples[(read - 1) * 2 + 1];
+    }
+
+    for (u32 i = read; i < frames; i++)
+    {
+        samples[i * 2 + 0] = audio->_last[0];
+        samples[i * 2 + 1] = audio->_last[1];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+class AudioRing;
+
+// Plays whatever the emulator writes to the ring. The device pulls samples
+// from its own thread, if the ring runs dry the last sample is held.
+class SdlAudio
+{
+public:
+    SdlAudio();
+    virtual ~SdlAudio();
+
+    // nullptr if no audio device could be opened
+    AudioRing* GetRing() { return _ring.get(); }
+
+private:
+    static void SDLCALL Callback(void* userdata, Uint8* stream, int len);
+
+private:
+    SDL_AudioDeviceID _device;
+    std::unique_ptr<AudioRing> _ring;
+    i16 _last[2];
+};
\ No newline at end of file
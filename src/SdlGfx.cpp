@@ -1,11 +1,19 @@
 #include "stdafx.h"
 #include <SDL.h>
 #include "SdlGfx.h"
-#include <chrono>
+#include "pacer.h"
+#include <cmath>
+
+// Use vsync when the display is within this fraction of the Game Boy's rate,
+// each refresh then shows the newest frame and the odd one is shown twice or not at all
+static const double VSYNC_TOLERANCE = 0.02;
 
 SdlGfx::SdlGfx()
+    : _vsync(false)
+    , _refreshRate(0)
 {
-    SDL_InitSubSystem(SDL_INIT_VIDEO);
+    // the timer subsystem raises the OS timer resolution so FramePacer can sleep accurately
+    SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_TIMER);
     _window = SDL_CreateWindow(
         "GameBoy",
         SDL_WINDOWPOS_CENTERED,
@@ -15,10 +23,17 @@ SdlGfx::SdlGfx()
         SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE
     );
 
+    SDL_DisplayMode mode;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(_window), &mode) == 0 && mode.refresh_rate != 0)
+    {
+        _refreshRate = mode.refresh_rate;
+        _vsync = std::abs(mode.refresh_rate - FramePacer::FRAME_RATE) < FramePacer::FRAME_RATE * VSYNC_TOLERANCE;
+    }
+
     _renderer = SDL_CreateRenderer(
         _window,
         -1,
-        SDL_RENDERER_ACCELERATED// | SDL_RENDERER_PRESENTVSYNC
+        SDL_RENDERER_ACCELERATED | (_vsync ? SDL_RENDERER_PRESENTVSYNC : 0)
     );
 
     _texture = SDL_CreateTexture(
@@ -28,38 +43,19 @@ SdlGfx::SdlGfx()
         160,
         144
     );
-
-    _lastDrawTime = std::chrono::high_resolution_clock::now();
 }
 
 SdlGfx::~SdlGfx()
 {
-    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    SDL_QuitSubSystem(SDL_INIT_VIDEO | SDL_INIT_TIMER);
 }
 
-u8 palette[4] = { 0xFF, 0xD3, 0xA9, 0x00 };
-u8 screen[160 * 144 * 4];
+// SDL_PIXELFORMAT_ABGR8888 is packed, so this doesn't depend on byte order
+const u32 SdlGfx::PALETTE[4] = { 0x00FFFFFF, 0x00D3D3D3, 0x00A9A9A9, 0x00000000 };
 
-void SdlGfx::Blit(u8 gbScreen[])
+void SdlGfx::Blit(const u32 pixels[])
 {
-    std::chrono::time_point<std::chrono::steady_clock> now;
-    long long duration;
-    do
-    {
-        now = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - _lastDrawTime).count();
-    } while (duration < 16666667); // 60 fps
-    _lastDrawTime = now;
-
-    for (int i = 0; i < 160 * 144; i++)
-    {
-        screen[(i * 4) + 0] = palette[gbScreen[i]];
-        screen[(i * 4) + 1] = palette[gbScreen[i]];
-        screen[(i * 4) + 2] = palette[gbScreen[i]];
-        screen[(i * 4) + 3] = 0;
-    }
-
-    SDL_UpdateTexture(_texture, NULL, (void*)&screen, 160 * 4);
+    SDL_UpdateTexture(_texture, NULL, pixels, 160 * 4);
     SDL_RenderClear(_renderer);
     SDL_RenderCopy(_renderer, _texture, NULL, NULL);
     SDL_RenderPresent(_renderer);
@@ -4,20 +4,26 @@ struct SDL_Window;
 struct SDL_Renderer;
 struct SDL_Texture;
 
-#include <chrono>
-
 class SdlGfx
 {
 public:
     SdlGfx();
     virtual ~SdlGfx();
 
-    void Blit(u8 gbScreen[]);
+    // Shades 0-3 in the texture's pixel format
+    static const u32 PALETTE[4];
+
+    void Blit(const u32 pixels[]);
+
+    // Blit waits for the display's refresh when it is close to the Game Boy's rate
+    bool HasVsync() const { return _vsync; }
+    int RefreshRate() const { return _refreshRate; }
 
 private:
     SDL_Window* _window;
     SDL_Renderer* _renderer;
     SDL_Texture* _texture;
 
-    std::chrono::time_point<std::chrono::steady_clock> _lastDrawTime;
+    bool _vsync;
+    int _refreshRate;
 };
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include "stdafx.h"
 #include "SdlInput.h"
-#include "gameboy.h"
 
-SdlInput::SdlInput(Gameboy& gameboy)
-    : _gameboy(gameboy)
+SdlInput::SdlInput()
+    : _buttons(0)
+    , _rewinding(false)
+    , _turbo(false)
+    , _quitting(false)
 {
     SDL_InitSubSystem(SDL_INIT_EVENTS);
 }
@@ -33,7 +35,8 @@ void SdlInput::CheckInput()
             }
             break;
         case SDL_QUIT:
-            exit(0);
+            _quitting = true;
+            break;
         }
     }
 }
@@ -45,38 +48,56 @@ void SdlInput::HandleKey(SDL_Keycode code, bool pressed)
     case SDLK_LALT:
     case SDLK_s:
         //_controller0->A(pressed);
-        _gameboy.Button(4, pressed);
+        Button(4, pressed);
         break;
     case SDLK_LCTRL:
     case SDLK_a:
         //_controller0->B(pressed);
-        _gameboy.Button(5, pressed);
+        Button(5, pressed);
         break;
     case SDLK_RSHIFT:
     case SDLK_LSHIFT:
     case SDLK_BACKSLASH:
         //_controller0->Select(pressed);
-        _gameboy.Button(6, pressed);
+        Button(6, pressed);
         break;
     case SDLK_RETURN:
         //_controller0->Start(pressed);
-        _gameboy.Button(7, pressed);
+        Button(7, pressed);
         break;
     case SDLK_UP:
         //_controller0->Up(pressed);
-        _gameboy.Button(2, pressed);
+        Button(2, pressed);
         break;
     case SDLK_DOWN:
         //_controller0->Down(pressed);
-        _gameboy.Button(3, pressed);
+        Button(3, pressed);
         break;
     case SDLK_LEFT:
         //_controller0->Left(pressed);
-        _gameboy.Button(1, pressed);
+        Button(1, pressed);
         break;
     case SDLK_RIGHT:
         //_controller0->Right(pressed);
-        _gameboy.Button(0, pressed);
+        Button(0, pressed);
+        break;
+    case SDLK_BACKSPACE:
+        _rewinding = pressed;
+        break;
+    case SDLK_TAB:
+        _turbo = pressed;
         break;
     }
+}
+
+void SdlInput::Button(u8 idx, bool pressed)
+{
+    if (pressed)
+    {
+        _buttons |= 1 << idx;
+    }
+    else
+    {
+        _buttons &= ~(1 << idx);
+    }
 }
\ No newline at end of file
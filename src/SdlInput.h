@@ -1,18 +1,26 @@
 #pragma once
 
-class Gameboy;
-
 class SdlInput
 {
 public:
-    SdlInput(Gameboy& gameboy);
+    SdlInput();
     virtual ~SdlInput();
 
     void CheckInput();
 
+    // Bit n is the state of Gameboy::Button(n)
+    u8 GetButtons() const { return _buttons; }
+    bool IsRewinding() const { return _rewinding; }
+    bool IsTurbo() const { return _turbo; }
+    bool IsQuitting() const { return _quitting; }
+
 private:
     void HandleKey(SDL_Keycode code, bool pressed);
+    void Button(u8 idx, bool pressed);
 
 private:
-    Gameboy& _gameboy;
+    u8 _buttons;
+    bool _rewinding;
+    bool _turbo;
+    bool _quitting;
 };
\ No newline at end of file
@@ -0,0 +1,463 @@
+#include "stdafx.h"
+#include "analyzer.h"
+#include "cart.h"
+#include "symbols.h"
+#include "threadpool.h"
+
+typedef Disassembler::Instruction::Flow Flow;
+
+// Whether an instruction leaves something other than a known constant in A
+static bool WritesA(const u8 code[3])
+{
+    u8 op = code[0];
+    if (op == 0xCB)
+    {
+        // everything on A but BIT
+        return (code[1] & 0x07) == 0x07 && (code[1] & 0xC0) != 0x40;
+    }
+    if (op >= 0x40 && op < 0x80)
+    {
+        // LD A,r[z]
+        return op >= 0x78;
+    }
+    if (op >= 0x80 && op < 0xC0)
+    {
+        // alu[y] r[z], except CP
+        return op < 0xB8;
+    }
+
+    switch (op)
+    {
+    case 0x07:
+    case 0x0F:
+    case 0x17:
+    case 0x1F:
+    case 0x27:
+    case 0x2F:
+    case 0x3C:
+    case 0x3D:
+    case 0x0A:
+    case 0x1A:
+    case 0x2A:
+    case 0x3A:
+    case 0xF0:
+    case 0xF1:
+    case 0xF2:
+    case 0xFA:
+    case 0xC6:
+    case 0xCE:
+    case 0xD6:
+    case 0xDE:
+    case 0xE6:
+    case 0xEE:
+    case 0xF6:
+        return true;
+    default:
+        return false;
+    }
+}
+
+RomAnalyzer::RomAnalyzer(std::shared_ptr<const Rom> rom)
+    : _rom(rom)
+    , _map(rom->BankCount() * 0x4000, 0)
+    , _banks(rom->BankCount())
+{
+}
+
+RomAnalyzer::~RomAnalyzer()
+{
+}
+
+void RomAnalyzer::Analyze(ThreadPool& pool)
+{
+    if (_banks.empty())
+    {
+        return;
+    }
+
+    static const u16 ENTRY_POINTS[] =
+    {
+        0x0100,
+        0x0040, 0x0048, 0x0050, 0x0058, 0x0060,
+        0x0000, 0x0008, 0x0010, 0x0018, 0x0020, 0x0028, 0x0030, 0x0038,
+    };
+    _banks[0].Pending.assign(std::begin(ENTRY_POINTS), std::end(ENTRY_POINTS));
+
+    bool pending = true;
+    while (pending)
+    {
+        pool.Run(BankCount(), [this](u32 bank) { Walk(bank); });
+
+        // hand entry points over to their banks for the next round
+        pending = false;
+        for (BankState& state : _banks)
+        {
+            for (u32 offset : state.Outgoing)
+            {
+                if ((_map[offset] & (CODE | BLOCK_START)) != (CODE | BLOCK_START))
+                {
+                    _banks[Bank(offset)].Pending.push_back(Address(offset));
+                    pending = true;
+                }
+            }
+            state.Outgoing.clear();
+        }
+    }
+
+    pool.Run(BankCount(), [this](u32 bank) { BuildBlocks(bank); });
+
+    _blocks.clear();
+    for (BankState& state : _banks)
+    {
+        _blocks.insert(_blocks.end(), state.Blocks.begin(), state.Blocks.end());
+        state.Blocks.clear();
+        state.Blocks.shrink_to_fit();
+    }
+}
+
+u32 RomAnalyzer::CodeBytes(u32 bank) const
+{
+    u32 count = 0;
+    for (u32 i = bank * 0x4000; i < (bank + 1) * 0x4000; i++)
+    {
+        if ((_map[i] & (CODE | OPERAND)) != 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+const RomAnalyzer::Block* RomAnalyzer::FindBlock(u32 offset) const
+{
+    auto it = std::upper_bound(_blocks.begin(), _blocks.end(), offset,
+        [](u32 offset, const Block& block) { return offset < block.Start; });
+    if (it == _blocks.begin())
+    {
+        return nullptr;
+    }
+
+    --it;
+    return offset < it->Start + it->Length ? &*it : nullptr;
+}
+
+u32 RomAnalyzer::UnresolvedCount() const
+{
+    u32 count = 0;
+    for (const BankState& state : _banks)
+    {
+        count += state.Unresolved;
+    }
+    return count;
+}
+
+// Only ever touches this bank's part of the map
+void RomAnalyzer::Walk(u32 bank)
+{
+    BankState& state = _banks[bank];
+    u32 end = (bank + 1) * 0x4000;
+
+    Disassembler disassembler(nullptr);
+    Disassembler::Instruction instr;
+
+    while (!state.Pending.empty())
+    {
+        u16 pc = state.Pending.back();
+        state.Pending.pop_back();
+
+        u32 offset = Offset((u16)bank, pc);
+        if ((_map[offset] & OPERAND) != 0)
+        {
+            // lands inside another instruction
+            continue;
+        }
+        _map[offset] |= BLOCK_START;
+
+        // constants known to be in A and in the bank register, or -1
+        int a = -1;
+        int selected = -1;
+
+        bool fallsThrough = true;
+        while (offset < end && (_map[offset] & CODE) == 0)
+        {
+            if (!Decode(disassembler, offset, end, instr))
+            {
+                fallsThrough = false;
+                break;
+            }
+
+            _map[offset] |= CODE;
+            for (u32 i = 1; i < instr.Length(); i++)
+            {
+                _map[offset + i] |= OPERAND;
+            }
+
+            const u8* code = instr.CodeBytes();
+            Flow flow = instr.GetFlow();
+            if (flow == Flow::None)
+            {
+                if (code[0] == 0x3E)
+                {
+                    a = code[1];
+                }
+                else if (code[0] == 0xAF)
+                {
+                    a = 0;
+                }
+                else if (code[0] == 0xEA && IsBankRegister((u16)(code[1] | (code[2] << 8))))
+                {
+                    selected = a >= 0 ? (int)SelectedBank((u8)a) : -1;
+                }
+                else if (WritesA(code))
+                {
+                    a = -1;
+                }
+            }
+            else
+            {
+                // the callee, or the code jumped over, may leave anything in A
+                a = -1;
+                Follow(bank, selected, offset, instr);
+            }
+
+            offset += instr.Length();
+
+            if (flow == Flow::Jump || flow == Flow::Return || flow == Flow::IndirectJump)
+            {
+                fallsThrough = false;
+                break;
+            }
+            if (flow != Flow::None && offset < end)
+            {
+                _map[offset] |= BLOCK_START;
+            }
+        }
+
+        // ran into code walked before
+        if (fallsThrough && offset < end)
+        {
+            _map[offset] |= BLOCK_START;
+        }
+    }
+}
+
+void RomAnalyzer::Follow(u32 bank, int selected, u32 from, const Disassembler::Instruction& instr)
+{
+    Flow flow = instr.GetFlow();
+    if (flow != Flow::Jump && flow != Flow::ConditionalJump && flow != Flow::Call)
+    {
+        return;
+    }
+
+    BankState& state = _banks[bank];
+    u16 target = instr.Target();
+    if (target < 0x4000)
+    {
+        if (bank == 0)
+        {
+            state.Pending.push_back(target);
+        }
+        else
+        {
+            state.Outgoing.push_back(target);
+        }
+        state.Edges.push_back({ from, target });
+    }
+    else if (target < 0x8000)
+    {
+        if (bank != 0)
+        {
+            // code in switchable ROM stays in its own bank
+            state.Pending.push_back(target);
+            state.Edges.push_back({ from, Offset((u16)bank, target) });
+            return;
+        }
+
+        if (selected < 0 && BankCount() <= 2)
+        {
+            selected = 1;
+        }
+
+        if (selected < 0)
+        {
+            state.Unresolved++;
+            return;
+        }
+
+        u32 offset = Offset((u16)selected, target);
+        state.Outgoing.push_back(offset);
+        state.Edges.push_back({ from, offset });
+    }
+}
+
+bool RomAnalyzer::Decode(Disassembler& disassembler, u32 offset, u32 end, Disassembler::Instruction& instr) const
+{
+    u8 code[3] = { 0 };
+    for (u32 i = 0; i < 3 && offset + i < end; i++)
+    {
+        code[i] = (*_rom)[offset + i];
+    }
+
+    disassembler.Disassemble(Address(offset), code, instr);
+    if (instr.GetFlow() == Flow::Invalid || offset + instr.Length() > end)
+    {
+        return false;
+    }
+
+    // overlapping a different decoding of the same bytes
+    for (u32 i = 1; i < instr.Length(); i++)
+    {
+        if ((_map[offset + i] & CODE) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void RomAnalyzer::BuildBlocks(u32 bank)
+{
+    BankState& state = _banks[bank];
+    std::sort(state.Edges.begin(), state.Edges.end(),
+        [](const Edge& a, const Edge& b) { return a.From < b.From; });
+
+    Disassembler disassembler(nullptr);
+    Disassembler::Instruction instr;
+
+    u32 end = (bank + 1) * 0x4000;
+    u32 offset = bank * 0x4000;
+    while (offset < end)
+    {
+        if ((_map[offset] & CODE) == 0)
+        {
+            offset++;
+            continue;
+        }
+
+        Block block;
+        block.Start = offset;
+        block.Exit = Flow::None;
+        block.Next = NONE;
+        block.Target = NONE;
+
+        u32 last = offset;
+        do
+        {
+            // the map already says this decodes
+            u8 code[3] = { 0 };
+            for (u32 i = 0; i < 3 && offset + i < end; i++)
+            {
+                code[i] = (*_rom)[offset + i];
+            }
+            disassembler.Disassemble(Address(offset), code, instr);
+
+            last = offset;
+            offset += instr.Length();
+            block.Exit = instr.GetFlow();
+        } while (block.Exit == Flow::None && offset < end &&
+            (_map[offset] & (CODE | BLOCK_START)) == CODE);
+
+        block.Length = offset - block.Start;
+
+        bool fallsThrough = block.Exit != Flow::Jump && block.Exit != Flow::Return && block.Exit != Flow::IndirectJump;
+        if (fallsThrough && offset < end && (_map[offset] & CODE) != 0)
+        {
+            block.Next = offset;
+        }
+
+        auto edge = std::lower_bound(state.Edges.begin(), state.Edges.end(), last,
+            [](const Edge& edge, u32 from) { return edge.From < from; });
+        if (edge != state.Edges.end() && edge->From == last && (_map[edge->To] & CODE) != 0)
+        {
+            block.Target = edge->To;
+        }
+
+        state.Blocks.push_back(block);
+    }
+}
+
+bool RomAnalyzer::IsBankRegister(u16 addr) const
+{
+    switch (_rom->MBCID)
+    {
+    case MBC_1:
+    case MBC_3:
+        return addr >= 0x2000 && addr < 0x4000;
+    case MBC_5:
+        // only the low eight bits, 3000 - 3FFF holds the ninth
+        return addr >= 0x2000 && addr < 0x3000;
+    default:
+        return false;
+    }
+}
+
+u32 RomAnalyzer::SelectedBank(u8 val) const
+{
+    u32 bank = val;
+    switch (_rom->MBCID)
+    {
+    case MBC_1:
+        bank &= 0x1F;
+        break;
+    case MBC_3:
+        bank &= 0x7F;
+        break;
+    default:
+        break;
+    }
+
+    if (bank == 0 && _rom->MBCID != MBC_5)
+    {
+        bank = 1;
+    }
+
+    // banks past the end of the ROM wrap around, as in Cart::SetRomBank
+    return bank % BankCount();
+}
+
+bool RomAnalyzer::SaveListing(const char* path, const SymbolTable& symbols) const
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    Disassembler disassembler(nullptr);
+    Disassembler::Instruction instr;
+    for (const Block& block : _blocks)
+    {
+        fprintf(file, "%s:\n", symbols.Label(SymbolTable::Key(Bank(block.Start), Address(block.Start))).c_str());
+
+        u32 offset = block.Start;
+        while (offset < block.Start + block.Length)
+        {
+            u8 code[3] = { 0 };
+            for (u32 i = 0; i < 3 && offset + i < _map.size(); i++)
+            {
+                code[i] = (*_rom)[offset + i];
+            }
+            disassembler.Disassemble(Address(offset), code, instr);
+
+            fprintf(file, "    %02X:%04X  %-9s %s\n",
+                Bank(offset),
+                Address(offset),
+                instr.GetFormattedCodeBytes(),
+                instr.GetDisassemblyString());
+            offset += instr.Length();
+        }
+
+        if (block.Next != NONE)
+        {
+            fprintf(file, "    ; next %02X:%04X\n", Bank(block.Next), Address(block.Next));
+        }
+        if (block.Target != NONE)
+        {
+            fprintf(file, "    ; target %s\n", symbols.Label(SymbolTable::Key(Bank(block.Target), Address(block.Target))).c_str());
+        }
+        fprintf(file, "\n");
+    }
+
+    return fclose(file) == 0;
+}
\ No newline at end of file
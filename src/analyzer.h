@@ -0,0 +1,99 @@
+#pragma once
+
+#include "disassembler.h"
+
+class Rom;
+class SymbolTable;
+class ThreadPool;
+
+// Finds the code in a ROM ahead of time by following control flow from the
+// entry point at 0100, the interrupt vectors and the RST targets, producing a
+// map of which bytes are code and a graph of basic blocks.
+//
+// Code in bank 0 reaches switchable ROM through whichever bank is selected, so
+// the analyzer tracks constants loaded into A and stored to the MBC's bank
+// register, the usual "LD A,BANK / LD ($2000),A" sequence, and resolves far
+// jumps and calls with them. Those it can't resolve are counted, not guessed.
+//
+// Banks are walked in parallel. Each round walks every bank with pending entry
+// points on its own thread, touching only that bank's part of the map, and
+// entry points found in other banks are handed over for the next round.
+class RomAnalyzer
+{
+public:
+    // Per ROM byte
+    static const u8 CODE = 1 << 0;          // an instruction starts here
+    static const u8 OPERAND = 1 << 1;       // part of the instruction before
+    static const u8 BLOCK_START = 1 << 2;   // a basic block starts here
+
+    static const u32 NONE = UINT32_MAX;
+
+    // Offsets are into the ROM image, bank * 4000 + (address & 3FFF)
+    struct Block
+    {
+        u32 Start;
+        u32 Length;
+        Disassembler::Instruction::Flow Exit;
+        u32 Next;       // the block that follows on, or NONE
+        u32 Target;     // the block jumped or called to, or NONE if unknown or not in ROM
+    };
+
+private:
+    struct Edge
+    {
+        u32 From;       // the jump or call
+        u32 To;
+    };
+
+    struct BankState
+    {
+        BankState() : Unresolved(0) {}
+
+        std::vector<u16> Pending;           // entry points, as addresses
+        std::vector<u32> Outgoing;          // entry points found in other banks, as offsets
+        std::vector<Edge> Edges;
+        std::vector<Block> Blocks;
+        u32 Unresolved;
+    };
+
+public:
+    RomAnalyzer(std::shared_ptr<const Rom> rom);
+    virtual ~RomAnalyzer();
+
+    void Analyze(ThreadPool& pool);
+
+    u32 BankCount() const { return (u32)_banks.size(); }
+    u8 Flags(u32 offset) const { return _map[offset]; }
+    const std::vector<u8>& CodeMap() const { return _map; }
+    u32 CodeBytes(u32 bank) const;
+
+    // Sorted by Start
+    const std::vector<Block>& Blocks() const { return _blocks; }
+    const Block* FindBlock(u32 offset) const;
+
+    // Far jumps and calls from bank 0 whose bank wasn't known
+    u32 UnresolvedCount() const;
+
+    static u16 Bank(u32 offset) { return (u16)(offset / 0x4000); }
+    static u16 Address(u32 offset) { return (u16)(offset < 0x4000 ? offset : 0x4000 | (offset & 0x3FFF)); }
+    static u32 Offset(u16 bank, u16 addr) { return addr < 0x4000 ? addr : bank * 0x4000 + (addr & 0x3FFF); }
+
+    // Every block with its disassembly and successors
+    bool SaveListing(const char* path, const SymbolTable& symbols) const;
+
+private:
+    void Walk(u32 bank);
+    void Follow(u32 bank, int selected, u32 from, const Disassembler::Instruction& instr);
+    bool Decode(Disassembler& disassembler, u32 offset, u32 end, Disassembler::Instruction& instr) const;
+    void BuildBlocks(u32 bank);
+
+    // The MBC's ROM bank register, and the bank a value written to it selects
+    bool IsBankRegister(u16 addr) const;
+    u32 SelectedBank(u8 val) const;
+
+private:
+    std::shared_ptr<const Rom> _rom;
+    std::vector<u8> _map;
+    std::vector<BankState> _banks;
+    std::vector<Block> _blocks;
+};
\ No newline at end of file
@@ -0,0 +1,670 @@
+#include "stdafx.h"
+#include "apu.h"
+#include "gameboy.h"
+#include "cpu.h"
+#include "audioring.h"
+#include "state.h"
+
+const u32 Apu::CLOCK_RATE = 4194304;
+const u32 Apu::FRAME_SEQUENCER_PERIOD = 8192;
+
+// Bits of FF10 - FF2F that always read back as 1
+static const u8 READ_MASKS[0x20] =
+{
+    0x80, 0x3F, 0x00, 0xFF, 0xBF,
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+    0xFF, 0xFF, 0x00, 0x00, 0xBF,
+    0x00, 0x00, 0x70, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF,
+};
+
+// FF10 - FF26 as left by the boot ROM
+static const u8 BOOT_REGS[0x17] =
+{
+    0x80, 0xBF, 0xF3, 0xFF, 0xBF,
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+    0xFF, 0xFF, 0x00, 0x00, 0xBF,
+    0x77, 0xF3, 0x80,
+};
+
+// Output of each duty cycle for steps 0 - 7, most significant bit first
+static const u8 DUTY_PATTERNS[4] = { 0x01, 0x81, 0x87, 0x7E };
+
+static const u8 WAVE_SHIFTS[4] = { 4, 0, 1, 2 };
+
+static const u8 NOISE_DIVISORS[8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+
+// Output is buffered for at most this fraction of a second between frames
+static const u32 MAX_BUFFERED_DIVISOR = 10;
+
+// Headless, catch up at the end of a frame once a second behind so a game that
+// never touches the APU doesn't leave a long catch up for later
+static const int HEADLESS_CATCH_UP_CYCLES = (int)Apu::CLOCK_RATE;
+
+Apu::Apu(const Gameboy& gameboy)
+    : _gameboy(gameboy)
+    , _cpu(nullptr)
+    , _power(false)
+    , _sweepFrequency(0)
+    , _sweepTimer(0)
+    , _sweepEnabled(false)
+    , _lfsr(0x7FFF)
+    , _sequencerStep(0)
+    , _sequencerTimer(FRAME_SEQUENCER_PERIOD)
+    , _cycles(0)
+    , _output(nullptr)
+    , _muted(false)
+    , _rateAdjust(1.0)
+    , _blipTime(0)
+{
+    memset(_regs, 0, sizeof(_regs));
+    memset(_channels, 0, sizeof(_channels));
+    memset(_levels, 0, sizeof(_levels));
+    memset(_gains, 0, sizeof(_gains));
+}
+
+Apu::~Apu()
+{
+}
+
+void Apu::Init()
+{
+    _cpu = _gameboy._cpu;
+
+    memcpy(_regs, BOOT_REGS, sizeof(BOOT_REGS));
+    _power = true;
+
+    // the boot sound has faded out but channel 1 is still on
+    _channels[SQUARE1].Enabled = true;
+}
+
+void Apu::UnInit()
+{
+    _cpu = nullptr;
+}
+
+void Apu::Serialize(StateStream& state)
+{
+    if (!state.IsLoading())
+    {
+        Step();
+    }
+
+    state.Bytes(_regs, sizeof(_regs));
+    state.Value(_power);
+
+    for (u32 ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        state.Value(_channels[ch].Enabled);
+        state.Value(_channels[ch].Length);
+        state.Value(_channels[ch].Timer);
+        state.Value(_channels[ch].Position);
+        state.Value(_channels[ch].Volume);
+        state.Value(_channels[ch].EnvelopeTimer);
+    }
+
+    state.Value(_sweepFrequency);
+    state.Value(_sweepTimer);
+    state.Value(_sweepEnabled);
+    state.Value(_lfsr);
+    state.Value(_sequencerStep);
+    state.Value(_sequencerTimer);
+    state.Value(_cycles);
+
+    if (state.IsLoading())
+    {
+        // continue the output from the new levels rather than clearing it
+        StartSynthesis();
+    }
+}
+
+void Apu::SetOutput(AudioRing* output)
+{
+    _output = output;
+    _rateAdjust = 1.0;
+    memset(_levels, 0, sizeof(_levels));
+    memset(_gains, 0, sizeof(_gains));
+
+    if (_output != nullptr)
+    {
+        for (BlipBuffer& blip : _blip)
+        {
+            blip.SetRates(CLOCK_RATE, _output->SampleRate(), _output->SampleRate() / MAX_BUFFERED_DIVISOR);
+            blip.Clear();
+        }
+    }
+
+    StartSynthesis();
+}
+
+void Apu::SetRateAdjust(double ratio)
+{
+    _rateAdjust = ratio;
+    if (_output != nullptr)
+    {
+        for (BlipBuffer& blip : _blip)
+        {
+            blip.SetRates(CLOCK_RATE, _output->SampleRate() * _rateAdjust, _output->SampleRate() / MAX_BUFFERED_DIVISOR);
+        }
+    }
+}
+
+void Apu::SetMuted(bool muted)
+{
+    _muted = muted;
+    StartSynthesis();
+}
+
+// Output continues from now, with the mixer brought up to the current levels
+void Apu::StartSynthesis()
+{
+    if (_cpu != nullptr)
+    {
+        Step();
+    }
+    _blipTime = _cycles;
+
+    UpdateGains();
+    UpdateLevels();
+}
+
+u8 Apu::Read(u16 addr)
+{
+    Step();
+
+    if (addr >= 0xFF30)
+    {
+        // Wave RAM
+        return Reg(addr);
+    }
+
+    if (addr == 0xFF26)
+    {
+        u8 val = (_power ? 0x80 : 0x00) | READ_MASKS[addr - 0xFF10];
+        for (u32 ch = 0; ch < NUM_CHANNELS; ch++)
+        {
+            if (_channels[ch].Enabled)
+            {
+                val |= 1 << ch;
+            }
+        }
+        return val;
+    }
+
+    return Reg(addr) | READ_MASKS[addr - 0xFF10];
+}
+
+void Apu::Write(u16 addr, u8 val)
+{
+    Step();
+
+    if (addr >= 0xFF30)
+    {
+        // Wave RAM
+        Reg(addr) = val;
+        return;
+    }
+
+    if (addr == 0xFF26)
+    {
+        bool power = (val & 0x80) != 0;
+        if (_power && !power)
+        {
+            PowerOff();
+        }
+        else if (!_power && power)
+        {
+            _power = true;
+            _sequencerStep = 0;
+            _sequencerTimer = FRAME_SEQUENCER_PERIOD;
+            for (Channel& channel : _channels)
+            {
+                channel.Position = 0;
+            }
+        }
+        return;
+    }
+
+    // registers can't be written while powered off
+    if (!_power)
+    {
+        return;
+    }
+
+    Reg(addr) = val;
+
+    switch (addr)
+    {
+    case 0xFF11:
+    case 0xFF16:
+    case 0xFF20:
+        _channels[(addr - 0xFF10) / 5].Length = 64 - (val & 0x3F);
+        break;
+    case 0xFF1B:
+        _channels[WAVE].Length = 256 - val;
+        break;
+    case 0xFF12:
+    case 0xFF17:
+    case 0xFF1A:
+    case 0xFF21:
+        if (!DacEnabled((addr - 0xFF10) / 5))
+        {
+            _channels[(addr - 0xFF10) / 5].Enabled = false;
+        }
+        break;
+    case 0xFF14:
+    case 0xFF19:
+    case 0xFF1E:
+    case 0xFF23:
+        if ((val & 0x80) != 0)
+        {
+            Trigger((addr - 0xFF10) / 5);
+        }
+        break;
+    case 0xFF24:
+    case 0xFF25:
+        UpdateGains();
+        break;
+    }
+
+    UpdateLevels();
+}
+
+u16 Apu::Frequency(u32 ch) const
+{
+    return (u16)(((_regs[ch * 5 + 4] & 0x07) << 8) | _regs[ch * 5 + 3]);
+}
+
+// Cycles between waveform steps, 0 if the channel isn't clocked
+int Apu::Period(u32 ch) const
+{
+    switch (ch)
+    {
+    case SQUARE1:
+    case SQUARE2:
+        return (2048 - Frequency(ch)) * 4;
+    case WAVE:
+        return (2048 - Frequency(ch)) * 2;
+    case NOISE:
+        {
+            u8 nr43 = _regs[0x12];
+            u8 shift = nr43 >> 4;
+            return shift < 14 ? NOISE_DIVISORS[nr43 & 0x07] << shift : 0;
+        }
+    }
+    return 0;
+}
+
+bool Apu::DacEnabled(u32 ch) const
+{
+    if (ch == WAVE)
+    {
+        return (_regs[0x0A] & 0x80) != 0;
+    }
+    return (_regs[ch * 5 + 2] & 0xF8) != 0;
+}
+
+void Apu::Trigger(u32 ch)
+{
+    Channel& channel = _channels[ch];
+    channel.Enabled = DacEnabled(ch);
+
+    if (channel.Length == 0)
+    {
+        channel.Length = ch == WAVE ? 256 : 64;
+    }
+
+    channel.Timer = Period(ch);
+    channel.Volume = _regs[ch * 5 + 2] >> 4;
+    channel.EnvelopeTimer = _regs[ch * 5 + 2] & 0x07;
+
+    switch (ch)
+    {
+    case SQUARE1:
+        {
+            u8 nr10 = _regs[0x00];
+            u8 period = (nr10 >> 4) & 0x07;
+            _sweepFrequency = Frequency(SQUARE1);
+            _sweepTimer = period != 0 ? period : 8;
+            _sweepEnabled = period != 0 || (nr10 & 0x07) != 0;
+            if ((nr10 & 0x07) != 0)
+            {
+                SweepCalculate();
+            }
+        }
+        break;
+    case WAVE:
+        channel.Position = 0;
+        break;
+    case NOISE:
+        _lfsr = 0x7FFF;
+        break;
+    }
+}
+
+void Apu::PowerOff()
+{
+    memset(_regs, 0, 0x16);
+    for (Channel& channel : _channels)
+    {
+        channel.Enabled = false;
+    }
+    _power = false;
+
+    UpdateLevels();
+    UpdateGains();
+}
+
+void Apu::Step()
+{
+    int target = (int)_cpu->GetCycles();
+    if (!_power)
+    {
+        _cycles = target;
+        return;
+    }
+
+    while (_cycles < target)
+    {
+        int end = std::min(target, _cycles + _sequencerTimer);
+        RunChannels(end);
+
+        _sequencerTimer -= end - _cycles;
+        _cycles = end;
+
+        if (_sequencerTimer == 0)
+        {
+            _sequencerTimer = FRAME_SEQUENCER_PERIOD;
+            ClockSequencer();
+        }
+    }
+}
+
+void Apu::EndFrame()
+{
+    if (!Synthesizing())
+    {
+        if (_cycles < -HEADLESS_CATCH_UP_CYCLES)
+        {
+            Step();
+        }
+        return;
+    }
+
+    Step();
+
+    u32 time = _cycles - _blipTime;
+    _blipTime = _cycles;
+
+    if (!Synthesizing())
+    {
+        return;
+    }
+
+    for (BlipBuffer& blip : _blip)
+    {
+        blip.EndFrame(time);
+    }
+
+    u32 count = _blip[0].SamplesAvailable();
+    if (_samples.size() < count * 2)
+    {
+        _samples.resize(count * 2);
+    }
+
+    _blip[0].ReadSamples(&_samples[0], count, 2);
+    _blip[1].ReadSamples(&_samples[1], count, 2);
+    _output->Write(&_samples[0], count);
+}
+
+// Walks each channel from one waveform step to the next up to end. Nothing
+// that changes a channel's period can happen in between.
+void Apu::RunChannels(int end)
+{
+    bool synthesizing = Synthesizing();
+    for (u32 ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        Channel& channel = _channels[ch];
+        int period = Period(ch);
+        if (!channel.Enabled || period == 0)
+        {
+            continue;
+        }
+
+        int time = _cycles + channel.Timer;
+
+        // when nobody is listening only the noise LFSR needs stepping
+        if (!synthesizing && ch != NOISE && time <= end)
+        {
+            int steps = (end - time) / period + 1;
+            channel.Position = (channel.Position + steps) & (ch == WAVE ? 0x1F : 0x07);
+            time += steps * period;
+        }
+
+        while (time <= end)
+        {
+            switch (ch)
+            {
+            case SQUARE1:
+            case SQUARE2:
+                channel.Position = (channel.Position + 1) & 0x07;
+                break;
+            case WAVE:
+                channel.Position = (channel.Position + 1) & 0x1F;
+                break;
+            case NOISE:
+                {
+                    u16 bit = (_lfsr ^ (_lfsr >> 1)) & 0x01;
+                    _lfsr = (_lfsr >> 1) | (bit << 14);
+                    if ((_regs[0x12] & 0x08) != 0)
+                    {
+                        _lfsr = (_lfsr & ~0x40) | (bit << 6);
+                    }
+                }
+                break;
+            }
+
+            if (synthesizing)
+            {
+                SetLevel(ch, time, Level(ch));
+            }
+            time += period;
+        }
+        channel.Timer = time - end;
+    }
+}
+
+void Apu::ClockSequencer()
+{
+    if ((_sequencerStep & 0x01) == 0)
+    {
+        ClockLength();
+    }
+    if (_sequencerStep == 2 || _sequencerStep == 6)
+    {
+        ClockSweep();
+    }
+    if (_sequencerStep == 7)
+    {
+        ClockEnvelope();
+    }
+    _sequencerStep = (_sequencerStep + 1) & 0x07;
+
+    UpdateLevels();
+}
+
+void Apu::ClockLength()
+{
+    for (u32 ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        Channel& channel = _channels[ch];
+        if ((_regs[ch * 5 + 4] & 0x40) != 0 && channel.Length > 0)
+        {
+            if (--channel.Length == 0)
+            {
+                channel.Enabled = false;
+            }
+        }
+    }
+}
+
+void Apu::ClockSweep()
+{
+    if (_sweepTimer > 0)
+    {
+        _sweepTimer--;
+    }
+    if (_sweepTimer != 0)
+    {
+        return;
+    }
+
+    u8 nr10 = _regs[0x00];
+    u8 period = (nr10 >> 4) & 0x07;
+    _sweepTimer = period != 0 ? period : 8;
+
+    if (_sweepEnabled && period != 0)
+    {
+        u16 freq = SweepCalculate();
+        if (freq <= 2047 && (nr10 & 0x07) != 0)
+        {
+            _sweepFrequency = freq;
+            _regs[0x03] = freq & 0xFF;
+            _regs[0x04] = (_regs[0x04] & ~0x07) | (freq >> 8);
+
+            // the new frequency is checked for overflow straight away too
+            SweepCalculate();
+        }
+    }
+}
+
+u16 Apu::SweepCalculate()
+{
+    u8 nr10 = _regs[0x00];
+    u16 delta = _sweepFrequency >> (nr10 & 0x07);
+    u16 freq = (nr10 & 0x08) != 0 ? _sweepFrequency - delta : _sweepFrequency + delta;
+    if (freq > 2047)
+    {
+        _channels[SQUARE1].Enabled = false;
+    }
+    return freq;
+}
+
+void Apu::ClockEnvelope()
+{
+    static const u32 ENVELOPE_CHANNELS[3] = { SQUARE1, SQUARE2, NOISE };
+    for (u32 ch : ENVELOPE_CHANNELS)
+    {
+        Channel& channel = _channels[ch];
+        u8 nrx2 = _regs[ch * 5 + 2];
+        u8 period = nrx2 & 0x07;
+        if (!channel.Enabled || period == 0)
+        {
+            continue;
+        }
+
+        if (channel.EnvelopeTimer > 0)
+        {
+            channel.EnvelopeTimer--;
+        }
+        if (channel.EnvelopeTimer == 0)
+        {
+            channel.EnvelopeTimer = period;
+            if ((nrx2 & 0x08) != 0 && channel.Volume < 15)
+            {
+                channel.Volume++;
+            }
+            else if ((nrx2 & 0x08) == 0 && channel.Volume > 0)
+            {
+                channel.Volume--;
+            }
+        }
+    }
+}
+
+// Digital output of a channel, 0 - 15
+u8 Apu::Level(u32 ch) const
+{
+    const Channel& channel = _channels[ch];
+    if (!channel.Enabled)
+    {
+        return 0;
+    }
+
+    switch (ch)
+    {
+    case SQUARE1:
+    case SQUARE2:
+        {
+            u8 duty = _regs[ch * 5 + 1] >> 6;
+            return ((DUTY_PATTERNS[duty] >> (7 - channel.Position)) & 0x01) != 0 ? channel.Volume : 0;
+        }
+    case WAVE:
+        {
+            u8 sample = _regs[0x20 + channel.Position / 2];
+            sample = (channel.Position & 0x01) != 0 ? sample & 0x0F : sample >> 4;
+            return sample >> WAVE_SHIFTS[(_regs[0x0C] >> 5) & 0x03];
+        }
+    case NOISE:
+        return (_lfsr & 0x01) == 0 ? channel.Volume : 0;
+    }
+    return 0;
+}
+
+void Apu::SetLevel(u32 ch, int time, u8 level)
+{
+    if (!Synthesizing() || level == _levels[ch])
+    {
+        return;
+    }
+
+    int delta = level - _levels[ch];
+    _levels[ch] = level;
+
+    for (u32 side = 0; side < 2; side++)
+    {
+        if (_gains[side][ch] != 0)
+        {
+            _blip[side].AddDelta(time - _blipTime, delta * _gains[side][ch]);
+        }
+    }
+}
+
+void Apu::UpdateLevels()
+{
+    for (u32 ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        SetLevel(ch, _cycles, Level(ch));
+    }
+}
+
+// NR50 is the volume of each side, NR51 which channels go to which side
+void Apu::UpdateGains()
+{
+    if (!Synthesizing())
+    {
+        return;
+    }
+
+    u8 nr50 = _regs[0x14];
+    u8 nr51 = _regs[0x15];
+    for (u32 ch = 0; ch < NUM_CHANNELS; ch++)
+    {
+        int gains[2];
+        gains[0] = (nr51 & (0x10 << ch)) != 0 ? ((nr50 >> 4) & 0x07) + 1 : 0;
+        gains[1] = (nr51 & (0x01 << ch)) != 0 ? (nr50 & 0x07) + 1 : 0;
+
+        for (u32 side = 0; side < 2; side++)
+        {
+            int delta = gains[side] - _gains[side][ch];
+            if (delta != 0 && _levels[ch] != 0)
+            {
+                _blip[side].AddDelta(_cycles - _blipTime, delta * _levels[ch]);
+            }
+            _gains[side][ch] = gains[side];
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "cpu.h"
+#include "blipbuffer.h"
+
+class Gameboy;
+class StateStream;
+class AudioRing;
+
+// Sound is generated lazily. Step catches the channels up to the CPU whenever a
+// register is accessed and at the end of each frame, walking from one waveform
+// edge to the next and inserting a band-limited step into the output for each
+// change in level, rather than running every cycle.
+//
+// Without an output the APU runs headless. Nothing is synthesized, waveform
+// positions are advanced arithmetically and the end of frame catch up is
+// skipped, so the APU only does any work when the game touches its registers
+// or the state is saved. Register values and save states are the same either way.
+class Apu
+{
+    // Constants
+public:
+    static const u32 CLOCK_RATE;
+
+private:
+    static const u32 FRAME_SEQUENCER_PERIOD;
+
+    // Helper Structs/Classes
+private:
+    enum ChannelId
+    {
+        SQUARE1,
+        SQUARE2,
+        WAVE,
+        NOISE,
+        NUM_CHANNELS
+    };
+
+    struct Channel
+    {
+        bool Enabled;
+        u16 Length;
+        int Timer;          // cycles until the next waveform step
+        u8 Position;        // duty step or wave sample
+        u8 Volume;
+        u8 EnvelopeTimer;
+    };
+
+public:
+    Apu(const Gameboy& gameboy);
+    virtual ~Apu();
+
+    void Init();
+    void UnInit();
+
+    void Serialize(StateStream& state);
+
+    // Samples are only generated while there is somewhere to put them. Muted
+    // frames, e.g. frames run ahead that will be rolled back, generate nothing
+    // and leave no gap in the output.
+    void SetOutput(AudioRing* output);
+    AudioRing* GetOutput() const { return _output; }
+    void SetMuted(bool muted);
+
+    // Resample to ratio times the output's sample rate, to make small
+    // corrections for a host that doesn't run at exactly the Game Boy's rate
+    void SetRateAdjust(double ratio);
+
+    // I/O FF10 - FF3F
+public:
+    u8 Read(u16 addr);
+    void Write(u16 addr, u8 val);
+
+    void Step();
+
+    void BeforeFrame()
+    {
+        _cycles -= _cpu->GetCycles();
+        _blipTime -= _cpu->GetCycles();
+    }
+    void EndFrame();
+
+private:
+    u8& Reg(u16 addr) { return _regs[addr - 0xFF10]; }
+    u16 Frequency(u32 ch) const;
+    int Period(u32 ch) const;
+    bool DacEnabled(u32 ch) const;
+
+    void StartSynthesis();
+
+    void Trigger(u32 ch);
+    void PowerOff();
+
+    void RunChannels(int end);
+    void ClockSequencer();
+    void ClockLength();
+    void ClockSweep();
+    void ClockEnvelope();
+    u16 SweepCalculate();
+
+    // Mixing
+private:
+    bool Synthesizing() const { return _output != nullptr && !_muted; }
+    u8 Level(u32 ch) const;
+    void SetLevel(u32 ch, int time, u8 level);
+    void UpdateLevels();
+    void UpdateGains();
+
+private:
+    const Gameboy& _gameboy;
+    std::shared_ptr<Cpu> _cpu;
+
+    // FF10 - FF3F, including wave RAM
+    u8 _regs[0x30];
+
+    bool _power;
+    Channel _channels[NUM_CHANNELS];
+
+    u16 _sweepFrequency;
+    u8 _sweepTimer;
+    bool _sweepEnabled;
+
+    u16 _lfsr;
+
+    u8 _sequencerStep;
+    int _sequencerTimer;
+
+    int _cycles;
+
+    // Output
+private:
+    AudioRing* _output;
+    bool _muted;
+    double _rateAdjust;
+    BlipBuffer _blip[2];
+    int _blipTime;
+    std::vector<i16> _samples;
+
+    // Levels and volumes as last handed to the mixer, only updated while synthesizing
+    u8 _levels[NUM_CHANNELS];
+    int _gains[2][NUM_CHANNELS];
+};
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "stdafx.h"
+#include "audioring.h"
+
+AudioRing::AudioRing(u32 capacity, u32 sampleRate)
+    : _sampleRate(sampleRate)
+    , _write(0)
+    , _read(0)
+{
+    u32 size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    _mask = size - 1;
+    _samples.resize(size * 2, 0);
+}
+
+AudioRing::~AudioRing()
+{
+}
+
+u32 AudioRing::Write(const i16* samples, u32 frames)
+{
+    u32 write = _write.load(std::memory_order_relaxed);
+    u32 read = _read.load(std::memory_order_acquire);
+    frames = std::min(frames, Capacity() - (write - read));
+
+    for (u32 i = 0; i < frames; i++)
+    {
+        u32 index = ((write + i) & _mask) * 2;
+        _samples[index + 0] = samples[i * 2 + 0];
+        _samples[index + 1] = samples[i * 2 + 1];
+    }
+
+    _write.store(write + frames, std::memory_order_release);
+    return frames;
+}
+
+u32 AudioRing::Read(i16* samples, u32 frames)
+{
+    u32 read = _read.load(std::memory_order_relaxed);
+    u32 write = _write.load(std::memory_order_acquire);
+    frames = std::min(frames, write - read);
+
+    for (u32 i = 0; i < frames; i++)
+    {
+        u32 index = ((read + i) & _mask) * 2;
+        samples[i * 2 + 0] = _samples[index + 0];
+        samples[i * 2 + 1] = _samples[index + 1];
+    }
+
+    _read.store(read + frames, std::memory_order_release);
+    return frames;
+}
\ No newline at end of file
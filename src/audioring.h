@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer, single consumer ring of interleaved stereo 16-bit
+// samples. The emulation thread writes, the audio callback reads. Neither side
+// blocks, a full ring drops the newest samples and an empty one reads short.
+class AudioRing
+{
+public:
+    // capacity is in stereo frames and is rounded up to a power of two
+    AudioRing(u32 capacity, u32 sampleRate);
+    virtual ~AudioRing();
+
+    u32 SampleRate() const { return _sampleRate; }
+    u32 Capacity() const { return _mask + 1; }
+
+    // Number of frames waiting to be read
+    u32 Available() const { return _write.load(std::memory_order_acquire) - _read.load(std::memory_order_acquire); }
+
+    u32 Write(const i16* samples, u32 frames);
+    u32 Read(i16* samples, u32 frames);
+
+private:
+    u32 _sampleRate;
+    u32 _mask;
+    std::vector<i16> _samples;
+
+    // free running frame counts, wrapped with _mask on access
+    std::atomic<u32> _write;
+    std::atomic<u32> _read;
+};
\ No newline at end of file
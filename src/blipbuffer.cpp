@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include "blipbuffer.h"
+#include <cmath>
+
+// Kernel taps sum to 1 << KERNEL_SHIFT
+static const u32 KERNEL_SHIFT = 15;
+
+// Fraction of the output Nyquist frequency that is passed
+static const double CUTOFF = 0.9;
+
+// Samples are scaled by this many bits on output, and the high-pass filter
+// that removes DC has a time constant of 1 << DC_SHIFT samples
+static const u32 OUTPUT_SHIFT = 6;
+static const u32 DC_SHIFT = 9;
+
+i16 BlipBuffer::KERNEL[BlipBuffer::PHASES][BlipBuffer::KERNEL_WIDTH];
+
+BlipBuffer::BlipBuffer()
+    : _factor(0)
+    , _offset(0)
+    , _integrator(0)
+    , _dcOffset(0)
+{
+    // built once, on whichever thread creates the first buffer
+    static bool initialized = InitKernel();
+    (void)initialized;
+}
+
+BlipBuffer::~BlipBuffer()
+{
+}
+
+// Blackman windowed sinc, one row per sub-sample phase
+bool BlipBuffer::InitKernel()
+{
+    const double PI = 3.14159265358979323846;
+    for (u32 phase = 0; phase < PHASES; phase++)
+    {
+        double taps[KERNEL_WIDTH];
+        double sum = 0.0;
+        for (u32 i = 0; i < KERNEL_WIDTH; i++)
+        {
+            double x = (double)i - (double)(KERNEL_WIDTH / 2 - 1) - (double)phase / PHASES;
+            double sinc = x == 0.0 ? 1.0 : sin(PI * x * CUTOFF) / (PI * x * CUTOFF);
+            double w = (x + KERNEL_WIDTH / 2) / KERNEL_WIDTH;
+            double window = 0.42 - 0.5 * cos(2.0 * PI * w) + 0.08 * cos(4.0 * PI * w);
+            taps[i] = sinc * window;
+            sum += taps[i];
+        }
+
+        // normalize so a step of 1 integrates to exactly 1 whatever the phase
+        i32 total = 0;
+        u32 largest = 0;
+        for (u32 i = 0; i < KERNEL_WIDTH; i++)
+        {
+            KERNEL[phase][i] = (i16)floor(taps[i] / sum * (1 << KERNEL_SHIFT) + 0.5);
+            total += KERNEL[phase][i];
+            if (KERNEL[phase][i] > KERNEL[phase][largest])
+            {
+                largest = i;
+            }
+        }
+        KERNEL[phase][largest] += (i16)((1 << KERNEL_SHIFT) - total);
+    }
+
+    return true;
+}
+
+void BlipBuffer::SetRates(double clockRate, double sampleRate, u32 maxSamples)
+{
+    _factor = (u64)(sampleRate / clockRate * 4294967296.0 + 0.5);
+    if (_buffer.size() != maxSamples + KERNEL_WIDTH)
+    {
+        _buffer.assign(maxSamples + KERNEL_WIDTH, 0);
+        _offset = 0;
+    }
+}
+
+void BlipBuffer::Clear()
+{
+    std::fill(_buffer.begin(), _buffer.end(), 0);
+    _offset = 0;
+    _integrator = 0;
+    _dcOffset = 0;
+}
+
+void BlipBuffer::EndFrame(u32 time)
+{
+    _offset += time * _factor;
+
+    // the caller stopped reading, drop the oldest samples rather than overflow
+    u32 max = (u32)_buffer.size() - KERNEL_WIDTH;
+    if (SamplesAvailable() > max)
+    {
+        ReadSamples(nullptr, SamplesAvailable() - max, 0);
+    }
+}
+
+u32 BlipBuffer::ReadSamples(i16* out, u32 count, u32 stride)
+{
+    count = std::min(count, SamplesAvailable());
+
+    // A frame longer than the buffer leaves more samples available than it
+    // holds. Nothing was added past its end, so those samples are flat.
+    u32 size = (u32)_buffer.size();
+
+    i32 integrator = _integrator;
+    i32 dcOffset = _dcOffset;
+    for (u32 i = 0; i < count; i++)
+    {
+        if (i < size)
+        {
+            integrator += _buffer[i];
+        }
+
+        // one pole high-pass to remove the DC the unipolar channels produce
+        i32 sample = integrator >> (KERNEL_SHIFT - OUTPUT_SHIFT);
+        i32 filtered = sample - (dcOffset >> DC_SHIFT);
+        dcOffset += filtered;
+
+        if (out != nullptr)
+        {
+            out[i * stride] = (i16)std::max(-32768, std::min(32767, filtered));
+        }
+    }
+    _integrator = integrator;
+    _dcOffset = dcOffset;
+
+    // keep the tails of kernels that reach past what was read
+    if (count < size)
+    {
+        u32 remaining = std::min(SamplesAvailable() - count + KERNEL_WIDTH, size - count);
+        memmove(&_buffer[0], &_buffer[count], remaining * sizeof(i32));
+        std::fill(_buffer.begin() + remaining, _buffer.begin() + std::min(remaining + count, size), 0);
+    }
+    else
+    {
+        std::fill(_buffer.begin(), _buffer.end(), 0);
+    }
+    _offset -= (u64)count << 32;
+
+    return count;
+}
\ No newline at end of file
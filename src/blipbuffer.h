@@ -0,0 +1,59 @@
+#pragma once
+
+// Band-limited synthesis of a signal that only ever changes in steps. Each
+// AddDelta inserts a windowed-sinc step at its exact sub-sample position, so
+// square waves clocked at 4 MHz don't alias when resampled to the output rate.
+// Deltas are accumulated between EndFrame calls and integrated on ReadSamples.
+class BlipBuffer
+{
+public:
+    static const u32 PHASE_BITS = 5;
+    static const u32 PHASES = 1 << PHASE_BITS;
+    static const u32 KERNEL_WIDTH = 16;
+
+public:
+    BlipBuffer();
+    virtual ~BlipBuffer();
+
+    // maxSamples is how many samples may be buffered between reads
+    void SetRates(double clockRate, double sampleRate, u32 maxSamples);
+    void Clear();
+
+    // time is in clocks since the last EndFrame
+    void AddDelta(u32 time, i32 delta)
+    {
+        u64 pos = _offset + time * _factor;
+        u32 index = (u32)(pos >> 32);
+        if (index + KERNEL_WIDTH > _buffer.size())
+        {
+            return;
+        }
+
+        const i16* kernel = KERNEL[(pos >> (32 - PHASE_BITS)) & (PHASES - 1)];
+        i32* out = &_buffer[index];
+        for (u32 i = 0; i < KERNEL_WIDTH; i++)
+        {
+            out[i] += delta * kernel[i];
+        }
+    }
+
+    void EndFrame(u32 time);
+    u32 SamplesAvailable() const { return (u32)(_offset >> 32); }
+
+    // Writes count samples to out, stride apart, and removes them from the buffer
+    u32 ReadSamples(i16* out, u32 count, u32 stride);
+
+private:
+    static i16 KERNEL[PHASES][KERNEL_WIDTH];
+    static bool InitKernel();
+
+private:
+    // output samples per clock, and the position of the next clock, 32.32 fixed point
+    u64 _factor;
+    u64 _offset;
+
+    std::vector<i32> _buffer;
+
+    i32 _integrator;
+    i32 _dcOffset;
+};
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "capi.h"
+#include "gameboy.h"
+#include "cart.h"
+#include "pagedmemory.h"
+#include "screenbuffer.h"
+#include "threadpool.h"
+
+struct gb_rom
+{
+    std::shared_ptr<const Rom> Image;
+};
+
+struct gb_instance
+{
+    std::unique_ptr<Gameboy> Emulator;
+    ScreenBuffer::Format Format;
+    u32 Scale;
+};
+
+struct gb_pool
+{
+    gb_pool(u32 threads) : Pool(threads) {}
+
+    ThreadPool Pool;
+};
+
+static gb_instance* Wrap(std::unique_ptr<Gameboy> gameboy, ScreenBuffer::Format format, u32 scale)
+{
+    gb_instance* instance = new gb_instance;
+    instance->Emulator = std::move(gameboy);
+    instance->Format = format;
+    instance->Scale = scale;
+    return instance;
+}
+
+static ScreenBuffer Screen(const gb_instance* instance, u8* screen)
+{
+    if (screen == nullptr)
+    {
+        return ScreenBuffer();
+    }
+
+    return ScreenBuffer(screen, instance->Format, instance->Scale);
+}
+
+static void Step(gb_instance* instance, u8 buttons, u32 frames, u8* screen)
+{
+    Gameboy& gameboy = *instance->Emulator;
+
+    // every button is set rather than only changes, as a loaded state brings
+    // its own buttons with it
+    for (u8 i = 0; i < 8; i++)
+    {
+        gameboy.Button(i, (buttons & (1 << i)) != 0);
+    }
+
+    for (u32 i = 0; i < frames; i++)
+    {
+        gameboy.DoFrame(Screen(instance, i + 1 == frames ? screen : nullptr));
+    }
+}
+
+gb_rom* gb_rom_load(const char* path)
+{
+    std::shared_ptr<MappedRom> rom = std::make_shared<MappedRom>(path);
+    if (!rom->Init())
+    {
+        return nullptr;
+    }
+
+    gb_rom* handle = new gb_rom;
+    handle->Image = rom;
+    return handle;
+}
+
+void gb_rom_free(gb_rom* rom)
+{
+    delete rom;
+}
+
+gb_instance* gb_create(const gb_rom* rom)
+{
+    std::unique_ptr<Gameboy> gameboy = std::make_unique<Gameboy>();
+    gameboy->InitShared(rom->Image);
+    return Wrap(std::move(gameboy), ScreenBuffer::Format::Shade8, 1);
+}
+
+gb_instance* gb_fork(gb_instance* instance)
+{
+    return Wrap(instance->Emulator->Fork(), instance->Format, instance->Scale);
+}
+
+void gb_destroy(gb_instance* instance)
+{
+    delete instance;
+}
+
+int gb_set_observation(gb_instance* instance, uint32_t format, uint32_t scale)
+{
+    if (format > GB_OBS_GRAY || (scale != 1 && scale != 2 && scale != 4))
+    {
+        return 0;
+    }
+
+    instance->Format = format == GB_OBS_GRAY ? ScreenBuffer::Format::Gray8 : ScreenBuffer::Format::Shade8;
+    instance->Scale = scale;
+    return 1;
+}
+
+void gb_step(gb_instance* instance, uint8_t buttons, uint32_t frames, uint8_t* screen)
+{
+    Step(instance, buttons, frames, screen);
+}
+
+void gb_run_cycles(gb_instance* instance, uint32_t cycles, uint8_t* screen)
+{
+    instance->Emulator->RunCycles(cycles, Screen(instance, screen));
+}
+
+int gb_run_until_pc(gb_instance* instance, uint16_t pc, uint32_t max_frames, uint8_t* screen)
+{
+    return instance->Emulator->RunUntilPC(pc, max_frames, Screen(instance, screen)) ? 1 : 0;
+}
+
+int gb_run_until_write(gb_instance* instance, uint16_t addr, uint32_t max_frames, uint8_t* screen)
+{
+    return instance->Emulator->RunUntilWrite(addr, max_frames, Screen(instance, screen)) ? 1 : 0;
+}
+
+int gb_run_until_scanline(gb_instance* instance, uint8_t line, uint32_t max_frames, uint8_t* screen)
+{
+    return instance->Emulator->RunUntilScanline(line, max_frames, Screen(instance, screen)) ? 1 : 0;
+}
+
+void gb_read_memory(gb_instance* instance, uint16_t addr, uint8_t* out, uint32_t size)
+{
+    for (u32 i = 0; i < size; i++)
+    {
+        out[i] = instance->Emulator->Peek((u16)(addr + i));
+    }
+}
+
+uint32_t gb_wram_view(gb_instance* instance, const uint8_t** pages, uint32_t count)
+{
+    const Gameboy& gameboy = *instance->Emulator;
+    for (u32 i = 0; i < count && i < gameboy.WramPageCount(); i++)
+    {
+        pages[i] = gameboy.WramPage(i);
+    }
+    return PagedMemory::PAGE_SIZE;
+}
+
+const uint8_t* gb_hram_view(gb_instance* instance)
+{
+    return instance->Emulator->Hram();
+}
+
+uint32_t gb_frame_count(const gb_instance* instance)
+{
+    return instance->Emulator->GetFrame();
+}
+
+size_t gb_state_size(gb_instance* instance)
+{
+    return instance->Emulator->SaveStateSize();
+}
+
+size_t gb_save_state(gb_instance* instance, uint8_t* buffer, size_t size)
+{
+    return instance->Emulator->SaveState(buffer, size);
+}
+
+int gb_load_state(gb_instance* instance, const uint8_t* buffer, size_t size)
+{
+    return instance->Emulator->LoadState(buffer, size) ? 1 : 0;
+}
+
+gb_pool* gb_pool_create(uint32_t threads)
+{
+    return new gb_pool(threads);
+}
+
+void gb_pool_destroy(gb_pool* pool)
+{
+    delete pool;
+}
+
+void gb_step_batch(gb_pool* pool, gb_instance* const* instances, uint32_t count,
+    const uint8_t* buttons, uint32_t frames, uint8_t* screens, size_t screen_stride)
+{
+    pool->Pool.Run(count, [&](u32 i)
+    {
+        Step(instances[i], buttons[i], frames, screens != nullptr ? screens + i * screen_stride : nullptr);
+    });
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+// A C interface to the emulator for use from other languages. Everything is
+// passed as plain pointers and fixed-width integers so the ABI stays stable.
+//
+// Buttons are a mask: bit 0 Right, 1 Left, 2 Up, 3 Down, 4 A, 5 B, 6 Select,
+// 7 Start. Screens are one byte per pixel, 160x144 unless downsampled, holding
+// either shades from 0 (lightest) to 3 or grayscale from 255 (lightest) to 0.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(GB_API_EXPORTS)
+#define GB_API __declspec(dllexport)
+#else
+#define GB_API __declspec(dllimport)
+#endif
+#else
+#define GB_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GB_SCREEN_WIDTH 160
+#define GB_SCREEN_HEIGHT 144
+#define GB_SCREEN_SIZE (GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT)
+
+#define GB_OBS_SHADE 0
+#define GB_OBS_GRAY 1
+
+typedef struct gb_rom gb_rom;
+typedef struct gb_instance gb_instance;
+typedef struct gb_pool gb_pool;
+
+// ROMs are memory-mapped and shared by every instance created from them.
+// Instances keep the ROM alive, so it can be freed as soon as they are created.
+GB_API gb_rom* gb_rom_load(const char* path);
+GB_API void gb_rom_free(gb_rom* rom);
+
+GB_API gb_instance* gb_create(const gb_rom* rom);
+GB_API gb_instance* gb_fork(gb_instance* instance);
+GB_API void gb_destroy(gb_instance* instance);
+
+// Sets what gb_step and gb_step_batch render: format is GB_OBS_SHADE or
+// GB_OBS_GRAY and scale 1, 2 or 4, downsampling as each line is drawn. Screens
+// are then (160 / scale) x (144 / scale). Returns 0 if either is invalid.
+GB_API int gb_set_observation(gb_instance* instance, uint32_t format, uint32_t scale);
+
+// Holds buttons for frames frames. Only the last frame is rendered, into
+// screen, and nothing is rendered if screen is NULL.
+GB_API void gb_step(gb_instance* instance, uint8_t buttons, uint32_t frames, uint8_t* screen);
+
+// Finer stepping, holding the buttons from the last gb_step. These stop on an
+// instruction boundary, possibly part way through a frame, and the next call
+// of any of them or gb_step carries on from there. Lines drawn meanwhile go to
+// screen, which may be NULL. The run_until calls return 1 if they stopped for
+// their condition, or 0 once max_frames frames have ended.
+GB_API void gb_run_cycles(gb_instance* instance, uint32_t cycles, uint8_t* screen);
+GB_API int gb_run_until_pc(gb_instance* instance, uint16_t pc, uint32_t max_frames, uint8_t* screen);
+GB_API int gb_run_until_write(gb_instance* instance, uint16_t addr, uint32_t max_frames, uint8_t* screen);
+GB_API int gb_run_until_scanline(gb_instance* instance, uint8_t line, uint32_t max_frames, uint8_t* screen);
+
+// Reads size bytes of the memory map from addr, as the CPU would see them
+GB_API void gb_read_memory(gb_instance* instance, uint16_t addr, uint8_t* out, uint32_t size);
+
+// Zero-copy views of work RAM, as pages of the returned size, and of the 127
+// bytes of high RAM. They are valid until the instance is next stepped,
+// loaded or forked.
+GB_API uint32_t gb_wram_view(gb_instance* instance, const uint8_t** pages, uint32_t count);
+GB_API const uint8_t* gb_hram_view(gb_instance* instance);
+
+GB_API uint32_t gb_frame_count(const gb_instance* instance);
+
+GB_API size_t gb_state_size(gb_instance* instance);
+
+// Returns the number of bytes written, or 0 if size is too small
+GB_API size_t gb_save_state(gb_instance* instance, uint8_t* buffer, size_t size);
+GB_API int gb_load_state(gb_instance* instance, const uint8_t* buffer, size_t size);
+
+// threads includes the calling thread, 0 uses one per hardware thread
+GB_API gb_pool* gb_pool_create(uint32_t threads);
+GB_API void gb_pool_destroy(gb_pool* pool);
+
+// Steps count instances in parallel, instance i holding buttons[i] for frames
+// frames. Screens are written to screens + i * screen_stride, or not rendered
+// if screens is NULL. No instance may appear twice.
+GB_API void gb_step_batch(gb_pool* pool, gb_instance* const* instances, uint32_t count,
+    const uint8_t* buttons, uint32_t frames, uint8_t* screens, size_t screen_stride);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -1,13 +1,16 @@
 #include "stdafx.h"
 #include "cart.h"
 #include "gameboy.h"
+#include "cpu.h"
+#include "savefile.h"
+#include "state.h"
 #include <fstream>
 
 bool Rom::Init()
 {
-    if (LoadFromFile())
+    if (LoadFromFile() && _size >= 0x8000)
     {
-        switch (_rom[0x147])
+        switch (_data[0x147])
         {
         case 0x09: HasSave = true;
         case 0x08: HasRam = true;
@@ -17,6 +20,19 @@ bool Rom::Init()
         case 0x02: HasRam = true;
         case 0x01: MBCID = MBC_1; break;
 
+        case 0x0F: HasRtc = true; HasSave = true; MBCID = MBC_3; break;
+        case 0x10: HasRtc = true;
+        case 0x13: HasSave = true;
+        case 0x12: HasRam = true;
+        case 0x11: MBCID = MBC_3; break;
+
+        case 0x1B:
+        case 0x1E: HasSave = true;
+        case 0x1A:
+        case 0x1D: HasRam = true;
+        case 0x19:
+        case 0x1C: MBCID = MBC_5; break;
+
         default:
             __debugbreak();
             MBCID = MBC_UNKNOWN;
@@ -25,13 +41,14 @@ bool Rom::Init()
 
         if (HasRam)
         {
-            switch (_rom[0x149])
+            switch (_data[0x149])
             {
             case 0x00: RamSize = 0x0000; HasRam = false;  break;
             case 0x01: RamSize = 0x0800; break;
             case 0x02: RamSize = 0x2000; break;
             case 0x03: RamSize = 0x8000; break;
             case 0x04: RamSize = 0x20000; break;
+            case 0x05: RamSize = 0x10000; break;
             default:
                 __debugbreak();
                 RamSize = 0;
@@ -65,61 +82,116 @@ bool StdRom::LoadFromFile()
         ifs.close();
     }
 
+    _data = _rom.data();
+    _size = _rom.size();
     return true;
 }
 
-MbcBase::MbcBase(const Rom& rom)
-    : _rom(rom)
-    , _romOffset(0x4000)
-    , _ramOffset(0x0000)
-    , _ram(rom.RamSize, 0xFF)
+MappedRom::MappedRom(const char* filePath)
+    : _filePath(filePath)
 {
 }
 
-MbcBase::~MbcBase()
+bool MappedRom::LoadFromFile()
 {
+    if (!_file.Open(_filePath))
+    {
+        return false;
+    }
+
+    _data = _file.Data();
+    _size = _file.Size();
+    return true;
 }
 
-u8 MbcBase::LoadRom(u16 addr)
+static const u64 RTC_CYCLES_PER_SECOND = 4194304;
+
+static const u8 RTC_MASKS[] = { 0x3F, 0x3F, 0x1F, 0xFF, 0xC1 };
+
+static const u8 RTC_DH_DAY_HIGH = 0x01;
+static const u8 RTC_DH_HALT = 0x40;
+static const u8 RTC_DH_CARRY = 0x80;
+
+Rtc::Rtc()
 {
-    return _rom[_romOffset + (addr & 0x3FFF)];
+    Reset();
 }
 
-void MbcBase::StoreRom(u16 addr, u8 val)
+void Rtc::Reset()
 {
-    // nothing for Rom Only
+    memset(_regs, 0, sizeof(_regs));
+    memset(_latched, 0, sizeof(_latched));
+    _time = 0;
+}
+
+void Rtc::Latch(u64 now)
+{
+    Update(now);
+    memcpy(_latched, _regs, sizeof(_regs));
 }
 
-u8 MbcBase::LoadRam(u16 addr)
+void Rtc::Write(u32 reg, u8 val, u64 now)
 {
-    if (!_rom.HasRam)
+    Update(now);
+    if (reg == RTC_S)
     {
-        __debugbreak();
-        return 0xFF;
+        // writing the seconds restarts the current second
+        _time = now;
     }
-    else
-        return _ram[_ramOffset + (addr - 0xA000)];
+    _regs[reg] = val & RTC_MASKS[reg];
 }
 
-void MbcBase::StoreRam(u16 addr, u8 val)
+void Rtc::Serialize(StateStream& state)
 {
-    if (!_rom.HasRam)
-    { }
-        //__debugbreak();
-    else
-        _ram[_ramOffset + (addr - 0xA000)] = val;
+    state.Value(_regs);
+    state.Value(_latched);
+    state.Value(_time);
 }
 
-Mbc1::Mbc1(const Rom& rom)
-    : MbcBase(rom)
+void Rtc::Update(u64 now)
 {
+    if ((_regs[RTC_DH] & RTC_DH_HALT) != 0)
+    {
+        _time = now;
+        return;
+    }
+
+    u64 seconds = (now - _time) / RTC_CYCLES_PER_SECOND;
+    if (seconds == 0)
+    {
+        return;
+    }
+    _time += seconds * RTC_CYCLES_PER_SECOND;
+
+    u64 total = _regs[RTC_S] + seconds;
+    _regs[RTC_S] = (u8)(total % 60);
+    total = total / 60 + _regs[RTC_M];
+    _regs[RTC_M] = (u8)(total % 60);
+    total = total / 60 + _regs[RTC_H];
+    _regs[RTC_H] = (u8)(total % 24);
+    total = total / 24 + (_regs[RTC_DL] | ((_regs[RTC_DH] & RTC_DH_DAY_HIGH) << 8));
+
+    // the day counter is 9 bits and sets the carry flag when it overflows,
+    // which stays set until the game clears it
+    _regs[RTC_DL] = (u8)total;
+    _regs[RTC_DH] = (_regs[RTC_DH] & ~RTC_DH_DAY_HIGH) | ((total >> 8) & RTC_DH_DAY_HIGH);
+    if (total > 0x1FF)
+    {
+        _regs[RTC_DH] |= RTC_DH_CARRY;
+    }
 }
 
-Mbc1::~Mbc1()
+// Read in place of RAM when an MBC3 register without a clock behind it is selected
+static const u8 OPEN_BUS = 0xFF;
+
+template <>
+void Cart::StoreControl<MBC_ROM_ONLY>(u16 addr, u8 val)
 {
+    // nothing for Rom Only
 }
 
-void Mbc1::StoreRom(u16 addr, u8 val)
+template <>
+void Cart::StoreControl<MBC_1>(u16 addr, u8 val)
 {
     if (addr < 0x2000)
     {
@@ -146,7 +218,7 @@ void Mbc1::StoreRom(u16 addr, u8 val)
     }
 }
 
-void Mbc1::CalculateOffsets()
+void Cart::CalculateOffsets()
 {
     u32 romBank = _reg2000;
     u32 ramBank = 0;
@@ -166,96 +238,318 @@ void Mbc1::CalculateOffsets()
         ramBank = _reg6000;
     }
 
-    _romOffset = romBank * 0x4000;
+    SetRomBank(romBank);
     _ramOffset = ramBank & 0x2000;
 }
 
+template <>
+void Cart::StoreControl<MBC_3>(u16 addr, u8 val)
+{
+    if (addr < 0x2000)
+    {
+        _ramEnabled = (val & 0x0F) == 0x0A;
+    }
+    else if (addr < 0x4000)
+    {
+        u32 romBank = val & 0x7F;
+        if (romBank == 0)
+        {
+            romBank++;
+        }
+        SetRomBank(romBank);
+    }
+    else if (addr < 0x6000)
+    {
+        _bankSelect = val & 0x0F;
+        if (_bankSelect < 0x08)
+        {
+            SetRamBank(_bankSelect);
+        }
+        MapRtcRegister();
+    }
+    else if (addr < 0x8000)
+    {
+        // writing 0 then 1 copies the clock into the readable registers
+        if (_latch == 0 && val == 1 && _rom->HasRtc)
+        {
+            _rtc.Latch(_gameboy._cpu->GetTotalCycles());
+        }
+        _latch = val;
+    }
+    else
+    {
+        __debugbreak();
+    }
+}
+
+template <>
+void Cart::StoreControl<MBC_5>(u16 addr, u8 val)
+{
+    if (addr < 0x2000)
+    {
+        _ramEnabled = (val & 0x0F) == 0x0A;
+    }
+    else if (addr < 0x3000)
+    {
+        _romBankNumber = (_romBankNumber & 0x100) | val;
+        SetRomBank(_romBankNumber);
+    }
+    else if (addr < 0x4000)
+    {
+        _romBankNumber = (_romBankNumber & 0xFF) | ((val & 0x01) << 8);
+        SetRomBank(_romBankNumber);
+    }
+    else if (addr < 0x6000)
+    {
+        // on rumble carts bit 3 drives the motor, but those carts have at
+        // most 4 banks so masking by the RAM size drops it
+        SetRamBank(val & 0x0F);
+    }
+    else if (addr < 0x8000)
+    {
+        // nothing mapped here
+    }
+    else
+    {
+        __debugbreak();
+    }
+}
+
 Cart::Cart(const Gameboy& gameboy)
     : _gameboy(gameboy)
     , _rom(nullptr)
     , _mbcId(MBC_ROM_ONLY)
-    , _mbc1(nullptr)
+    , _storeRom(&Cart::StoreRomThunk<MBC_ROM_ONLY>)
+    , _romOffset(0x4000)
+    , _ramOffset(0x0000)
+    , _ramEnabled(false)
+    , _ramRegister(nullptr)
+    , _ramDirty(false)
+    , _saveFile(nullptr)
+    , _reg2000(0)
+    , _reg4000(0)
+    , _reg6000(false)
+    , _bankSelect(0)
+    , _latch(0xFF)
+    , _romBankNumber(1)
 {
+    _romBanks[0] = nullptr;
+    _romBanks[1] = nullptr;
 }
 
 Cart::~Cart()
 {
+    CloseSaveFile();
 }
 
-void Cart::Init(std::unique_ptr<Rom> rom)
+void Cart::Init(std::shared_ptr<const Rom> rom)
 {
-    _rom = std::move(rom);
-    _rom->Init();
+    CloseSaveFile();
+
+    _rom = rom;
 
     _mbcId = _rom->MBCID;
     switch (_mbcId)
     {
     case MBC_1:
-        _mbc1 = std::make_unique<Mbc1>(*_rom.get());
+        _storeRom = &Cart::StoreRomThunk<MBC_1>;
+        break;
+    case MBC_3:
+        _storeRom = &Cart::StoreRomThunk<MBC_3>;
+        break;
+    case MBC_5:
+        _storeRom = &Cart::StoreRomThunk<MBC_5>;
+        break;
+    default:
+        _storeRom = &Cart::StoreRomThunk<MBC_ROM_ONLY>;
+        break;
     }
+
+    _romBanks[0] = _rom->Data();
+    SetRomBank(1);
+    _ramOffset = 0x0000;
+    _ramEnabled = false;
+    _ram.Resize(_rom->RamSize, 0xFF);
+    _ramRegister = nullptr;
+    _dirtyPages.assign(_ram.PageCount(), 0);
+    _ramDirty = false;
+
+    _reg2000 = 0;
+    _reg4000 = 0;
+    _reg6000 = false;
+
+    _bankSelect = 0;
+    _latch = 0xFF;
+    _rtc.Reset();
+
+    _romBankNumber = 1;
 }
 
 void Cart::UnInit()
 {
+    CloseSaveFile();
 }
 
-u8 Cart::LoadRom(u16 addr)
+// ROM only carts can still have RAM (types 0x08 and 0x09), so only the MBC
+// registers depend on the type
+void Cart::Serialize(StateStream& state)
 {
-    switch (addr & 0x4000)
+    state.Value(_romOffset);
+    state.Value(_ramOffset);
+    state.Value(_ramEnabled);
+    state.Memory(_ram);
+
+    switch (_mbcId)
     {
-    case 0x0000:
-        return (*_rom)[addr & 0x3FFF];
-    case 0x4000:
-        switch (_mbcId)
-        {
-        case MBC_ROM_ONLY:
-            return (*_rom)[addr & 0x7FFF];
-        case MBC_1:
-            return _mbc1->LoadRom(addr & 0x3FFF);
-        }
+    case MBC_1:
+        state.Value(_reg2000);
+        state.Value(_reg4000);
+        state.Value(_reg6000);
         break;
-    default:
-        __debugbreak();
+    case MBC_3:
+        state.Value(_bankSelect);
+        state.Value(_latch);
+        _rtc.Serialize(state);
+        break;
+    case MBC_5:
+        state.Value(_romBankNumber);
         break;
     }
 
-    return 0;
+    if (state.IsLoading())
+    {
+        // whatever was loaded is now the cart's RAM
+        std::fill(_dirtyPages.begin(), _dirtyPages.end(), 1);
+        _ramDirty = true;
+
+        SetRomBank(_romOffset / 0x4000);
+        if (_mbcId == MBC_3)
+        {
+            MapRtcRegister();
+        }
+    }
 }
 
-void Cart::StoreRom(u16 addr, u8 val)
+void Cart::StoreRam(u16 addr, u8 val)
 {
-    switch (_mbcId)
+    if (_ramRegister != nullptr)
     {
-    case MBC_ROM_ONLY:
-        break;
-    case MBC_1:
-        _mbc1->StoreRom(addr, val);
-        break;
+        if (_ramRegister != &OPEN_BUS)
+        {
+            _rtc.Write(_bankSelect - 0x08, val, _gameboy._cpu->GetTotalCycles());
+        }
+    }
+    else if (_rom->HasRam)
+    {
+        u32 offset = _ramOffset + (addr - 0xA000);
+        _ram.Store(offset, val);
+        _dirtyPages[offset >> PagedMemory::PAGE_SHIFT] = 1;
+        _ramDirty = true;
     }
 }
 
-u8 Cart::LoadRam(u16 addr)
+bool Cart::OpenSaveFile(const char* path)
 {
-    switch (_mbcId)
+    CloseSaveFile();
+    if (!_rom->HasSave || !_rom->HasRam)
     {
-    case MBC_ROM_ONLY:
-        __debugbreak();
-        return 0xFF;
-        break;
-    case MBC_1:
-        return _mbc1->LoadRam(addr);
-        break;
+        return false;
+    }
+
+    std::unique_ptr<SaveFile> saveFile = std::make_unique<SaveFile>();
+    if (!saveFile->Open(path, _ram.Size()))
+    {
+        return false;
+    }
+
+    const u8* saved = saveFile->SavedData();
+    for (u32 i = 0; i < _ram.PageCount(); i++)
+    {
+        u32 offset = i << PagedMemory::PAGE_SHIFT;
+        u32 size = _ram.PageSize(i);
+        if (saved != nullptr)
+        {
+            memcpy(_ram.WritePage(i), saved + offset, size);
+        }
+        else
+        {
+            // a new file starts out as the cart's current RAM
+            saveFile->Write(offset, _ram.ReadPage(i), size);
+        }
     }
+    saveFile->Flush();
+
+    std::fill(_dirtyPages.begin(), _dirtyPages.end(), 0);
+    _ramDirty = false;
+    _saveFile = std::move(saveFile);
+    return true;
 }
 
-void Cart::StoreRam(u16 addr, u8 val)
+// Loading states marks every page, so pages are compared before being copied
+// and the file is only flushed when its contents really changed
+void Cart::EndFrame()
 {
-    switch (_mbcId)
+    if (!_ramDirty)
     {
-    case MBC_ROM_ONLY:
-        break;
-    case MBC_1:
-        _mbc1->StoreRam(addr, val);
-        break;
+        return;
+    }
+    _ramDirty = false;
+
+    bool changed = false;
+    for (u32 i = 0; i < _dirtyPages.size(); i++)
+    {
+        if (_dirtyPages[i] != 0)
+        {
+            _dirtyPages[i] = 0;
+            if (_saveFile != nullptr)
+            {
+                u32 offset = i << PagedMemory::PAGE_SHIFT;
+                changed |= _saveFile->Write(offset, _ram.ReadPage(i), _ram.PageSize(i));
+            }
+        }
+    }
+
+    if (changed)
+    {
+        _saveFile->Flush();
+    }
+}
+
+void Cart::CloseSaveFile()
+{
+    if (_saveFile != nullptr)
+    {
+        // catch anything written since the last frame
+        EndFrame();
+        _saveFile = nullptr;
+    }
+}
+
+void Cart::SetRomBank(u32 bank)
+{
+    // banks past the end of the ROM wrap around like the unconnected address lines
+    _romOffset = (bank % _rom->BankCount()) * 0x4000;
+    _romBanks[1] = _rom->Data() + _romOffset;
+}
+
+void Cart::SetRamBank(u32 bank)
+{
+    if (_rom->HasRam)
+    {
+        _ramOffset = (bank * 0x2000) & (_rom->RamSize - 1);
+    }
+}
+
+// MBC3 maps the clock registers over RAM
+void Cart::MapRtcRegister()
+{
+    if (_bankSelect < 0x08)
+    {
+        _ramRegister = nullptr;
+    }
+    else
+    {
+        u32 reg = _bankSelect - 0x08;
+        _ramRegister = (_rom->HasRtc && reg < Rtc::RTC_COUNT) ? _rtc.Latched(reg) : &OPEN_BUS;
     }
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "pagedmemory.h"
+#include "mappedfile.h"
+
 class Gameboy;
+class StateStream;
+class SaveFile;
 
 enum MBC_IDENTIFIER
 {
@@ -9,14 +14,17 @@ enum MBC_IDENTIFIER
     MBC_2 = 2,
     MBC_3 = 3,
     MBC_4 = 4,
+    MBC_5 = 5,
 
     MBC_UNKNOWN
 };
 
+// A ROM image. Subclasses decide where the bytes live; the image is only ever
+// read through a pointer, so it can be shared or mapped without copying.
 class Rom
 {
 protected:
-    Rom() : _rom(0) {}
+    Rom() : MBCID(MBC_UNKNOWN), HasRam(false), HasSave(false), HasRtc(false), RamSize(0), _data(nullptr), _size(0) {}
 
 public:
     virtual ~Rom() { }
@@ -26,21 +34,28 @@ public:
     MBC_IDENTIFIER MBCID;
     bool HasRam;
     bool HasSave;
+    bool HasRtc;
     int RamSize;
 
 public:
     u8 operator [](int i) const
     {
-        return _rom[i];
+        return _data[i];
     }
 
+    const u8* Data() const { return _data; }
+    size_t Size() const { return _size; }
+    u32 BankCount() const { return (u32)(_size / 0x4000); }
+
 protected:
     virtual bool LoadFromFile() = 0;
 
 protected:
-    std::vector<u8> _rom;
+    const u8* _data;
+    size_t _size;
 };
 
+// Reads the whole file into memory
 class StdRom : public Rom
 {
 public:
@@ -50,65 +65,173 @@ public:
 
 private:
     const char* _filePath;
+    std::vector<u8> _rom;
 };
 
-class MbcBase
+// Maps the file instead of reading it, so only the banks a game touches are
+// ever loaded and every instance and process running the same ROM shares them
+class MappedRom : public Rom
 {
 public:
-    MbcBase(const Rom& rom);
-    virtual ~MbcBase();
+    MappedRom(const char* filePath);
 
-    virtual u8 LoadRom(u16 addr);
-    virtual void StoreRom(u16 addr, u8 val);
-    virtual u8 LoadRam(u16 addr);
-    virtual void StoreRam(u16 addr, u8 val);
-
-protected:
-    const Rom& _rom;
-
-    u32 _romOffset;
-    u32 _ramOffset;
+    virtual bool LoadFromFile();
 
-    bool _ramEnabled;
-    std::vector<u8> _ram;
+private:
+    const char* _filePath;
+    MappedFile _file;
 };
 
-class Mbc1 : public MbcBase
+// The MBC3 real time clock. It is driven by emulated CPU cycles rather than
+// wall time so runs stay deterministic, and only catches up when it is latched
+// or written.
+class Rtc
 {
 public:
-    Mbc1(const Rom& rom);
-    virtual ~Mbc1();
+    enum Reg
+    {
+        RTC_S,
+        RTC_M,
+        RTC_H,
+        RTC_DL,
+        RTC_DH,
 
-    virtual void StoreRom(u16 addr, u8 val) override;
+        RTC_COUNT
+    };
 
-protected:
-    virtual void CalculateOffsets();
+public:
+    Rtc();
 
-protected:
-    u8 _reg2000;
-    u8 _reg4000;
-    bool _reg6000;
+    void Reset();
+    void Latch(u64 now);
+    void Write(u32 reg, u8 val, u64 now);
+
+    // The latched registers are what the game reads
+    const u8* Latched(u32 reg) const { return &_latched[reg]; }
+
+    void Serialize(StateStream& state);
+
+private:
+    void Update(u64 now);
+
+private:
+    u8 _regs[RTC_COUNT];
+    u8 _latched[RTC_COUNT];
+
+    // The cycle the clock last counted up to, less any partial second
+    u64 _time;
 };
 
+// The cartridge and its memory bank controller. Reads never dispatch on the
+// MBC: bank switches recompute the bases of the two ROM windows and the offset
+// into RAM, and loads just index them. Writes to the control registers go
+// through a function pointer to the MBC's handler, chosen once at Init.
 class Cart
 {
 public:
     Cart(const Gameboy& gameboy);
     virtual ~Cart();
 
-    void Init(std::unique_ptr<Rom> rom);
+    void Init(std::shared_ptr<const Rom> rom);
     void UnInit();
 
-    u8 LoadRom(u16 addr);
-    void StoreRom(u16 addr, u8 val);
-    u8 LoadRam(u16 addr);
+    std::shared_ptr<const Rom> GetRom() const { return _rom; }
+
+    void Serialize(StateStream& state);
+
+    // Battery backed RAM is loaded from path if it holds a save, and from then
+    // on the pages written each frame are copied back at EndFrame
+    bool OpenSaveFile(const char* path);
+    void EndFrame();
+
+    // The bank mapped at 4000 - 7FFF
+    u16 RomBank() const { return (u16)(_romOffset / 0x4000); }
+
+    u8 LoadRom(u16 addr) const
+    {
+        return _romBanks[addr >> 14][addr & 0x3FFF];
+    }
+
+    void StoreRom(u16 addr, u8 val)
+    {
+        _storeRom(*this, addr, val);
+    }
+
+    u8 LoadRam(u16 addr) const
+    {
+        if (_ramRegister != nullptr)
+        {
+            return *_ramRegister;
+        }
+        else if (!_rom->HasRam)
+        {
+            __debugbreak();
+            return 0xFF;
+        }
+        else
+        {
+            return _ram.Load(_ramOffset + (addr - 0xA000));
+        }
+    }
+
     void StoreRam(u16 addr, u8 val);
 
+private:
+    typedef void (*StoreRomFunc)(Cart& cart, u16 addr, u8 val);
+
+    template <MBC_IDENTIFIER Id>
+    static void StoreRomThunk(Cart& cart, u16 addr, u8 val)
+    {
+        cart.StoreControl<Id>(addr, val);
+    }
+
+    template <MBC_IDENTIFIER Id>
+    void StoreControl(u16 addr, u8 val);
+
+    void CloseSaveFile();
+
+    void SetRomBank(u32 bank);
+    void SetRamBank(u32 bank);
+    void MapRtcRegister();
+
+    // MBC1
+    void CalculateOffsets();
+
 private:
     const Gameboy& _gameboy;
-    std::unique_ptr<Rom> _rom;
+    std::shared_ptr<const Rom> _rom;
 
 private:
     MBC_IDENTIFIER _mbcId;
-    std::unique_ptr<Mbc1> _mbc1;
+    StoreRomFunc _storeRom;
+
+    // Bases of 0000 - 3FFF and 4000 - 7FFF
+    const u8* _romBanks[2];
+
+    u32 _romOffset;
+    u32 _ramOffset;
+
+    bool _ramEnabled;
+    PagedMemory _ram;
+
+    // A register mapped over RAM instead of a RAM bank, or nullptr
+    const u8* _ramRegister;
+
+    // One flag per RAM page written since the last EndFrame
+    std::vector<u8> _dirtyPages;
+    bool _ramDirty;
+    std::unique_ptr<SaveFile> _saveFile;
+
+    // MBC1
+    u8 _reg2000;
+    u8 _reg4000;
+    bool _reg6000;
+
+    // MBC3: 0x00 - 0x07 selects a RAM bank, 0x08 - 0x0C an RTC register
+    u8 _bankSelect;
+    u8 _latch;
+    Rtc _rtc;
+
+    // MBC5
+    u16 _romBankNumber;
 };
\ No newline at end of file
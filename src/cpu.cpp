@@ -2,7 +2,11 @@
 #include "cpu.h"
 #include "gameboy.h"
 #include "memory.h"
-#include "disassembler.h"
+#include "cart.h"
+#include "trace.h"
+#include "profiler.h"
+#include "debugger.h"
+#include "state.h"
 
 const u8 Cpu::Z_FLAG = (1 << 7);
 const u8 Cpu::N_FLAG = (1 << 6);
@@ -38,8 +42,10 @@ const u32 Cpu::CB_CYCLES[8] = {
 Cpu::Cpu(const Gameboy& gameboy)
     : _gameboy(gameboy)
     , _mem(nullptr)
-    , _disassembler(nullptr)
+    , _trace(nullptr)
+    , _profiler(nullptr)
     , _cycles(0)
+    , _totalCycles(0)
     , _interrupt_ime(false)
     , _interrupt_ime_lag(false)
     , _interrupt_if(0)
@@ -85,9 +91,11 @@ Cpu::~Cpu()
 void Cpu::Init()
 {
     _mem = _gameboy._memoryMap;
-    _disassembler = std::make_unique<Disassembler>(_mem);
+    _debugger = _gameboy._debugger;
+    _cart = _gameboy._cart;
 
     _cycles = 0;
+    _totalCycles = 0;
 
     _interrupt_ime = false;
     _interrupt_ime_lag = false;
@@ -110,19 +118,43 @@ void Cpu::Init()
     _pOpSrc16 = nullptr;
     _pOpDst16 = nullptr;
     _pOpRW16 = nullptr;
-
-#ifdef TRACE
-    _traceLog = fopen("C:\\Users\\chuckr\\desktop\\gb.log", "w");
-#endif
 }
 
 void Cpu::UnInit()
 {
     _mem = nullptr;
-    _disassembler = nullptr;
+    _debugger = nullptr;
+    _cart = nullptr;
+    _trace = nullptr;
+    _profiler = nullptr;
+}
+
+void Cpu::Serialize(StateStream& state)
+{
+    state.Value(_regs);
+    state.Value(_PC);
+    state.Value(_SP);
+    state.Value(_cycles);
+    state.Value(_totalCycles);
+    state.Value(_interrupt_ime);
+    state.Value(_interrupt_ime_lag);
+    state.Value(_interrupt_if);
+    state.Value(_interrupt_ie);
+    state.Value(_isHalted);
 }
 
 u8 Cpu::Read8(u16 addr)
+{
+    u8 data = ReadBus8(addr);
+    if (_debugger->IsWatched(addr, Debugger::Access::Read))
+    {
+        _debugger->OnAccess(addr, data, Debugger::Access::Read);
+    }
+    return data;
+}
+
+// Opcode fetches come straight here, so they don't trip read watchpoints
+u8 Cpu::ReadBus8(u16 addr)
 {
     u8 data = 0;
     if (addr == 0xFF0F)
@@ -151,7 +183,7 @@ u16 Cpu::Read16(u16 addr)
 
 u8 Cpu::ReadPC8()
 {
-    return Read8(_PC++);
+    return ReadBus8(_PC++);
 }
 
 u16 Cpu::ReadPC16()
@@ -164,6 +196,11 @@ u16 Cpu::ReadPC16()
 
 void Cpu::Write8(u16 addr, u8 val)
 {
+    if (_debugger->IsWatched(addr, Debugger::Access::Write))
+    {
+        _debugger->OnAccess(addr, val, Debugger::Access::Write);
+    }
+
     if (addr == 0xFF0F)
     {
         _interrupt_if = val;
@@ -191,6 +228,23 @@ void Cpu::Write16(u16 addr, u16 val)
 }
 
 void Cpu::Step()
+{
+    if (_profiler != nullptr)
+    {
+        u16 pc = *_PC;
+        u16 bank = _cart->RomBank();
+        u32 node = _profiler->CurrentNode();
+        u32 start = _cycles;
+        Execute();
+        _profiler->Sample(pc, bank, node, _cycles - start);
+    }
+    else
+    {
+        Execute();
+    }
+}
+
+void Cpu::Execute()
 {
     if (!DoInterrupt())
     {
@@ -258,6 +312,11 @@ bool Cpu::DoInterrupt()
 
             _cycles += 4;
 
+            if (_profiler != nullptr)
+            {
+                _profiler->Call(*_PC, _cart->RomBank(), *_SP);
+            }
+
             DI();
             _interrupt_if &= ~(1 << i);
 
@@ -274,6 +333,9 @@ bool Cpu::DoInterrupt()
 
 void Cpu::DMA(u8 val)
 {
+    PERF_COUNT(DMA_TRANSFERS);
+    PERF_TIME(DMA_TICKS);
+
     Word srcAddr;
     srcAddr._1 = val;
 
@@ -292,7 +354,13 @@ void Cpu::DMA(u8 val)
 
 void Cpu::Decode()
 {
-    Trace();
+    PERF_COUNT(CPU_INSTRUCTIONS);
+    PERF_TIME(CPU_DECODE_TICKS);
+
+    if (_trace != nullptr)
+    {
+        Trace();
+    }
 
     u8 op = ReadPC8();
 
@@ -1292,6 +1360,11 @@ void Cpu::CALL(bool condition)
         _cycles += 4;
         push_help(*_PC);
         _PC = addr;
+
+        if (_profiler != nullptr)
+        {
+            _profiler->Call(addr, _cart->RomBank(), *_SP);
+        }
     }
 }
 
@@ -1301,6 +1374,11 @@ void Cpu::RST(u8 val)
     push_help(*_PC);
     _PC._0 = val;
     _PC._1 = 0;
+
+    if (_profiler != nullptr)
+    {
+        _profiler->Call(*_PC, _cart->RomBank(), *_SP);
+    }
 }
 
 void Cpu::RET(bool cond)
@@ -1309,6 +1387,11 @@ void Cpu::RET(bool cond)
     {
         _PC = pop_help();
         _cycles += 4;
+
+        if (_profiler != nullptr)
+        {
+            _profiler->Return(*_SP);
+        }
     }
 }
 
@@ -1440,33 +1523,24 @@ bool Cpu::bit_help(u8 val, u8 bitNum)
     return (val & (1 << bitNum)) != 0;
 }
 
-#if defined(TRACE)
 void Cpu::Trace()
 {
-    Disassembler::Instruction instr;
-    _disassembler->Disassemble(*_PC, instr);
-
-    fprintf(
-        _traceLog,
-        "%04X %-14s %-18s A:%02X B:%02X C:%02X D:%02X E:%02X F:%02X H:%02X L:%02X AF:%04X BC:%04X DE:%04X HL:%04X SP:%04X\n",
-        *_PC,
-        instr.GetFormattedCodeBytes().c_str(),
-        instr.GetDisassemblyString().c_str(),
-        _regs.AF.A,
-        _regs.BC.B,
-        _regs.BC.C,
-        _regs.DE.D,
-        _regs.DE.E,
-        _regs.AF.F,
-        _regs.HL.H,
-        _regs.HL.L,
-        *_regs.AF,
-        *_regs.BC,
-        *_regs.DE,
-        *_regs.HL,
-        *_SP
-        );
-}
-#else
-void Cpu::Trace() {}
-#endif
\ No newline at end of file
+    TraceRecord record;
+    record.Cycle = GetTotalCycles();
+    record.PC = *_PC;
+    record.Bank = _cart->RomBank();
+    record.AF = *_regs.AF;
+    record.BC = *_regs.BC;
+    record.DE = *_regs.DE;
+    record.HL = *_regs.HL;
+    record.SP = *_SP;
+    for (u16 i = 0; i < 3; i++)
+    {
+        // code almost always runs from ROM, which can skip the memory map
+        u16 addr = *_PC + i;
+        record.Code[i] = addr < 0x8000 ? _cart->LoadRom(addr) : _mem->Peek(addr);
+    }
+    memset(record.Reserved, 0, sizeof(record.Reserved));
+
+    _trace->Write(record);
+}
\ No newline at end of file
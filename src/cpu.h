@@ -2,7 +2,11 @@
 
 class Gameboy;
 class MemoryMap;
-class Disassembler;
+class Cart;
+class Debugger;
+class TraceBuffer;
+class Profiler;
+class StateStream;
 
 class Cpu
 {
@@ -23,14 +27,31 @@ public:
     void Init();
     void UnInit();
 
-    void BeforeFrame() { _cycles = 0; }
+    void Serialize(StateStream& state);
+
+    void BeforeFrame()
+    {
+        _totalCycles += _cycles;
+        _cycles = 0;
+    }
     void Step();
     void RequestInterrupt(InterruptType interrupt);
 
     u32 GetCycles() { return _cycles; }
+    u16 GetPC() { return *_PC; }
+
+    // Cycles since power on, for anything that keeps time across frames
+    u64 GetTotalCycles() { return _totalCycles + _cycles; }
+
+    // Records each instruction into trace until set back to nullptr
+    void SetTrace(TraceBuffer* trace) { _trace = trace; }
+
+    // Charges each step's cycles to profiler until set back to nullptr
+    void SetProfiler(Profiler* profiler) { _profiler = profiler; }
 
 private:
     u8 Read8(u16 addr);
+    u8 ReadBus8(u16 addr);
     u16 Read16(u16 addr);
 
     void Write8(u16 addr, u8 val);
@@ -39,6 +60,7 @@ private:
     u8 ReadPC8();
     u16 ReadPC16();
 
+    void Execute();
     bool DoInterrupt();
     void DMA(u8 val);
     void Decode();
@@ -47,9 +69,13 @@ private:
 private:
     const Gameboy& _gameboy;
     std::shared_ptr<MemoryMap> _mem;
-    std::unique_ptr<Disassembler> _disassembler;
+    std::shared_ptr<Debugger> _debugger;
+    std::shared_ptr<Cart> _cart;
+    TraceBuffer* _trace;
+    Profiler* _profiler;
 
     u32 _cycles;
+    u64 _totalCycles;
     static const u32 CYCLES[256];
     static const u32 CB_CYCLES[8];
 
@@ -445,8 +471,4 @@ private:
     u8 shift_right_help(u8 val, bool msb);
 
     bool bit_help(u8 val, u8 bitNum);
-
-#ifdef TRACE
-    FILE* _traceLog;
-#endif
 };
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "debugger.h"
+
+Debugger::Debugger()
+    : _armed(false)
+    , _breakPages()
+    , _watchPages()
+    , _watchPending(false)
+    , _lastWatch()
+    , _stopReason(StopReason::None)
+{
+}
+
+Debugger::~Debugger()
+{
+}
+
+void Debugger::AddBreakpoint(u16 addr)
+{
+    if (!HasBreakpoint(addr))
+    {
+        _breakpoints.push_back(addr);
+        UpdatePages();
+    }
+}
+
+void Debugger::RemoveBreakpoint(u16 addr)
+{
+    _breakpoints.erase(std::remove(_breakpoints.begin(), _breakpoints.end(), addr), _breakpoints.end());
+    UpdatePages();
+}
+
+bool Debugger::HasBreakpoint(u16 addr) const
+{
+    return std::find(_breakpoints.begin(), _breakpoints.end(), addr) != _breakpoints.end();
+}
+
+void Debugger::AddWatchpoint(u16 addr, Access access)
+{
+    for (Watchpoint& watchpoint : _watchpoints)
+    {
+        if (watchpoint.Addr == addr)
+        {
+            watchpoint.Access |= (u8)access;
+            UpdatePages();
+            return;
+        }
+    }
+
+    Watchpoint watchpoint;
+    watchpoint.Addr = addr;
+    watchpoint.Access = (u8)access;
+    _watchpoints.push_back(watchpoint);
+    UpdatePages();
+}
+
+void Debugger::RemoveWatchpoint(u16 addr, Access access)
+{
+    for (Watchpoint& watchpoint : _watchpoints)
+    {
+        if (watchpoint.Addr == addr)
+        {
+            watchpoint.Access &= ~(u8)access;
+        }
+    }
+
+    _watchpoints.erase(std::remove_if(_watchpoints.begin(), _watchpoints.end(),
+        [](const Watchpoint& watchpoint) {
+        return watchpoint.Access == 0;
+    }), _watchpoints.end());
+    UpdatePages();
+}
+
+bool Debugger::HasWatchpoint(u16 addr, Access access) const
+{
+    for (const Watchpoint& watchpoint : _watchpoints)
+    {
+        if (watchpoint.Addr == addr && (watchpoint.Access & (u8)access) == (u8)access)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debugger::Clear()
+{
+    _breakpoints.clear();
+    _watchpoints.clear();
+    UpdatePages();
+}
+
+void Debugger::UpdatePages()
+{
+    memset(_breakPages, 0, sizeof(_breakPages));
+    for (u16 addr : _breakpoints)
+    {
+        _breakPages[addr >> 11] |= 1 << ((addr >> 8) & 7);
+    }
+
+    memset(_watchPages, 0, sizeof(_watchPages));
+    for (const Watchpoint& watchpoint : _watchpoints)
+    {
+        _watchPages[watchpoint.Addr >> 8] |= watchpoint.Access;
+    }
+
+    _armed = !_breakpoints.empty() || !_watchpoints.empty();
+}
+
+// The page matched, now find the watchpoint itself
+void Debugger::OnAccess(u16 addr, u8 val, Access access)
+{
+    for (const Watchpoint& watchpoint : _watchpoints)
+    {
+        if (watchpoint.Addr == addr && (watchpoint.Access & (u8)access) != 0)
+        {
+            _lastWatch.Addr = addr;
+            _lastWatch.Value = val;
+            _lastWatch.Type = access;
+            _watchPending = true;
+            return;
+        }
+    }
+}
+
+void Debugger::BeginRun()
+{
+    _watchPending = false;
+    _stopReason = StopReason::None;
+}
+
+bool Debugger::ShouldStop(u16 pc)
+{
+    if (_watchPending)
+    {
+        _watchPending = false;
+        _stopReason = StopReason::Watchpoint;
+        return true;
+    }
+
+    if ((_breakPages[pc >> 11] & (1 << ((pc >> 8) & 7))) != 0 && HasBreakpoint(pc))
+    {
+        _stopReason = StopReason::Breakpoint;
+        return true;
+    }
+
+    return false;
+}
\ No newline at end of file
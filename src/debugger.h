@@ -0,0 +1,90 @@
+#pragma once
+
+// Breakpoints and watchpoints for tools, costing nothing while none are set.
+//
+// Gameboy only runs its checking loop while something is set, and that tests
+// a bit per 256 byte page of the PC before searching the breakpoints. The CPU
+// tests the same kind of per page bits on each access, so only accesses to a
+// watched page take the slow path into OnAccess.
+//
+// A breakpoint stops with its address about to execute. A watchpoint stops
+// after the instruction that made the access, which LastWatch describes.
+// Opcode fetches are not reads.
+class Debugger
+{
+public:
+    enum class Access : u8
+    {
+        Read = (1 << 0),
+        Write = (1 << 1),
+        ReadWrite = Read | Write,
+    };
+
+    enum class StopReason
+    {
+        None,
+        Breakpoint,
+        Watchpoint,
+    };
+
+    struct WatchHit
+    {
+        u16 Addr;
+        u8 Value;
+        Access Type;
+    };
+
+public:
+    Debugger();
+    virtual ~Debugger();
+
+    void AddBreakpoint(u16 addr);
+    void RemoveBreakpoint(u16 addr);
+    bool HasBreakpoint(u16 addr) const;
+
+    void AddWatchpoint(u16 addr, Access access);
+    void RemoveWatchpoint(u16 addr, Access access);
+    bool HasWatchpoint(u16 addr, Access access) const;
+
+    void Clear();
+
+    bool Armed() const { return _armed; }
+
+    // Why the last run stopped early
+    StopReason GetStopReason() const { return _stopReason; }
+    const WatchHit& LastWatch() const { return _lastWatch; }
+
+    // Called by Cpu
+    bool IsWatched(u16 addr, Access access) const
+    {
+        return (_watchPages[addr >> 8] & (u8)access) != 0;
+    }
+    void OnAccess(u16 addr, u8 val, Access access);
+
+    // Called by Gameboy
+    void BeginRun();
+    bool ShouldStop(u16 pc);
+
+private:
+    struct Watchpoint
+    {
+        u16 Addr;
+        u8 Access;
+    };
+
+    void UpdatePages();
+
+private:
+    std::vector<u16> _breakpoints;
+    std::vector<Watchpoint> _watchpoints;
+    bool _armed;
+
+    // A bit per 256 byte page with a breakpoint, and the access flags of the
+    // watchpoints on each page
+    u8 _breakPages[0x100 / 8];
+    u8 _watchPages[0x100];
+
+    bool _watchPending;
+    WatchHit _lastWatch;
+    StopReason _stopReason;
+};
\ No newline at end of file
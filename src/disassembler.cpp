@@ -2,40 +2,160 @@
 #include "disassembler.h"
 #include "memory.h"
 
-std::string Disassembler::Instruction::GetFormattedCodeBytes()
+static const char* const DECODE_ALU[] = { "ADD A,", "ADC A,", "SUB ", "SBC A,", "AND ", "XOR ", "OR ", "CP " };
+static const char* const DECODE_R[] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+static const char* const DECODE_RP[] = { "BC", "DE", "HL", "SP" };
+static const char* const DECODE_RP2[] = { "BC", "DE", "HL", "AF" };
+static const char* const DECODE_CC[] = { "NZ", "Z", "NC", "C" };
+static const char* const DECODE_ROT[] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+Disassembler::Instruction::Instruction()
+{
+    Reset();
+}
+
+void Disassembler::Instruction::Reset()
 {
-    std::stringstream ss;
-    ss << std::uppercase << std::hex;
+    _length = 0;
+    _textLength = 0;
+    _flow = Flow::None;
+    _target = 0;
+    _text[0] = '\0';
+    _codeText[0] = '\0';
+}
 
-    std::vector<u8>::iterator it = _codeBytes.begin();
-    do
+void Disassembler::Instruction::PushCodeByte(u8 val)
+{
+    if (_length < sizeof(_code))
     {
-        ss << std::setfill('0') << std::setw(2) << (i32)*it << ' ';
-        it++;
-    } while (it != _codeBytes.end());
+        _code[_length++] = val;
+    }
+}
 
-    return ss.str();
+void Disassembler::Instruction::FormatCodeBytes()
+{
+    char* out = _codeText;
+    for (u32 i = 0; i < _length; i++)
+    {
+        *out++ = HEX_DIGITS[_code[i] >> 4];
+        *out++ = HEX_DIGITS[_code[i] & 0xF];
+        *out++ = ' ';
+    }
+    *out = '\0';
 }
 
-std::string Disassembler::Instruction::GetDisassemblyString()
+void Disassembler::Instruction::DecodeFlow(u16 pc)
 {
-    return _ss.str();
+    u8 op = _code[0];
+    switch (op)
+    {
+    case 0x18:
+        _flow = Flow::Jump;
+        _target = (u16)(pc + 2 + (i8)_code[1]);
+        break;
+    case 0x20:
+    case 0x28:
+    case 0x30:
+    case 0x38:
+        _flow = Flow::ConditionalJump;
+        _target = (u16)(pc + 2 + (i8)_code[1]);
+        break;
+    case 0xC3:
+        _flow = Flow::Jump;
+        _target = (u16)(_code[1] | (_code[2] << 8));
+        break;
+    case 0xC2:
+    case 0xCA:
+    case 0xD2:
+    case 0xDA:
+        _flow = Flow::ConditionalJump;
+        _target = (u16)(_code[1] | (_code[2] << 8));
+        break;
+    case 0xCD:
+    case 0xC4:
+    case 0xCC:
+    case 0xD4:
+    case 0xDC:
+        _flow = Flow::Call;
+        _target = (u16)(_code[1] | (_code[2] << 8));
+        break;
+    case 0xC7:
+    case 0xCF:
+    case 0xD7:
+    case 0xDF:
+    case 0xE7:
+    case 0xEF:
+    case 0xF7:
+    case 0xFF:
+        _flow = Flow::Call;
+        _target = op & 0x38;
+        break;
+    case 0xC9:
+    case 0xD9:
+        _flow = Flow::Return;
+        break;
+    case 0xC0:
+    case 0xC8:
+    case 0xD0:
+    case 0xD8:
+        _flow = Flow::ConditionalReturn;
+        break;
+    case 0xE9:
+        _flow = Flow::IndirectJump;
+        break;
+    case 0xD3:
+    case 0xDB:
+    case 0xDD:
+    case 0xE3:
+    case 0xE4:
+    case 0xEB:
+    case 0xEC:
+    case 0xED:
+    case 0xF4:
+    case 0xFC:
+    case 0xFD:
+        _flow = Flow::Invalid;
+        break;
+    }
 }
 
-void Disassembler::Instruction::Reset()
+Disassembler::Instruction& Disassembler::Instruction::operator <<(const char* str)
 {
-    _codeBytes.clear();
-    _ss.clear();
+    while (*str != '\0')
+    {
+        *this << *str++;
+    }
+    return *this;
+}
+
+Disassembler::Instruction& Disassembler::Instruction::operator <<(char c)
+{
+    // the longest instruction is well short of this, but never overrun
+    if (_textLength < MAX_TEXT - 1)
+    {
+        _text[_textLength++] = c;
+        _text[_textLength] = '\0';
+    }
+    return *this;
+}
+
+Disassembler::Instruction& Disassembler::Instruction::operator <<(Hex8 val)
+{
+    return *this << '$' << HEX_DIGITS[val.Value >> 4] << HEX_DIGITS[val.Value & 0xF];
+}
+
+Disassembler::Instruction& Disassembler::Instruction::operator <<(Hex16 val)
+{
+    return *this << Hex8{ (u8)(val.Value >> 8) } << HEX_DIGITS[(val.Value >> 4) & 0xF] << HEX_DIGITS[val.Value & 0xF];
 }
 
 Disassembler::Disassembler(std::shared_ptr<MemoryMap> mem)
     : _mem(mem)
-    , _decode_alu{ "ADD A,", "ADC A,", "SUB ", "SBC A,", "AND ", "XOR ", "OR ", "CP " }
-    , _decode_r{ "B", "C", "D", "E", "H", "L", "(HL)", "A" }
-    , _decode_rp{ "BC", "DE", "HL", "SP" }
-    , _decode_rp2{ "BC", "DE", "HL", "AF" }
-    , _decode_cc{ "NZ", "Z", "NC", "C" }
-    , _decode_rot{ "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" }
+    , _pc(0)
+    , _code(nullptr)
+    , _codePC(0)
 {
 }
 
@@ -43,19 +163,27 @@ Disassembler::~Disassembler()
 {
 }
 
+void Disassembler::Disassemble(u16 pc, const u8 code[3], Disassembler::Instruction& instr)
+{
+    _code = code;
+    _codePC = pc;
+    Disassemble(pc, instr);
+    _code = nullptr;
+}
+
 void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
 {
     instr.Reset();
     _pc = pc;
 
     u8 op = Read8BumpPC();
-    instr._codeBytes.push_back(op);
+    instr.PushCodeByte(op);
 
     bool prefix = op == 0xCB;
     if (prefix)
     {
         op = Read8BumpPC();
-        instr._codeBytes.push_back(op);
+        instr.PushCodeByte(op);
     }
 
     u8 y = (op >> 3) & 0b111;
@@ -68,93 +196,93 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         {
         case 0x00:
             // NOP
-            instr._ss << "NOP";
+            instr << "NOP";
             break;
         case 0x08:
             // LD (nn),SP
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "LD (" << Display16BumpPC() << "),SP";
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "LD (" << Display16BumpPC() << "),SP";
             break;
         case 0x010:
             // STOP
-            instr._codeBytes.push_back(Read8PC()); // 0x00 byte
-            instr._ss << "STOP";
+            instr.PushCodeByte(Read8PC()); // 0x00 byte
+            instr << "STOP";
             break;
         case 0x18:
             // JR d
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "JR " << DisplayBranchTarget();
+            instr.PushCodeByte(Read8PC());
+            instr << "JR " << DisplayBranchTarget();
             break;
         case 0x20:
         case 0x28:
         case 0x30:
         case 0x38:
             // JR cc[y-4],d
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "JR " << _decode_cc[y - 4] << "," << DisplayBranchTarget();
+            instr.PushCodeByte(Read8PC());
+            instr << "JR " << DECODE_CC[y - 4] << "," << DisplayBranchTarget();
         break;
         case 0x01:
         case 0x11:
         case 0x21:
         case 0x31:
             // LD rp[p],nn
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "LD " << _decode_rp[p] << "," << Display16BumpPC();
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "LD " << DECODE_RP[p] << "," << Display16BumpPC();
             break;
         case 0x09:
         case 0x19:
         case 0x29:
         case 0x39:
             // ADD HL,rp[p]
-            instr._ss << "ADD HL," << _decode_rp[p];
+            instr << "ADD HL," << DECODE_RP[p];
             break;
         case 0x02:
             // LD (BC),A
-            instr._ss << "LD (BC),A";
+            instr << "LD (BC),A";
             break;
         case 0x12:
             // LD (DE),A
-            instr._ss << "LD (DE),A";
+            instr << "LD (DE),A";
             break;
         case 0x22:
             // LDI (HL),A
-            instr._ss << "LDI (HL),A";
+            instr << "LDI (HL),A";
             break;
         case 0x32:
             /// LDD (HL),A
-            instr._ss << "LDD (HL),A";
+            instr << "LDD (HL),A";
             break;
         case 0x0A:
             // LD A,(BC)
-            instr._ss << "LD A,(BC)";
+            instr << "LD A,(BC)";
             break;
         case 0x1A:
             // LD A,(DE)
-            instr._ss << "LD A,(DE)";
+            instr << "LD A,(DE)";
             break;
         case 0x2A:
             // LDI A,(HL)
-            instr._ss << "LDI A,(HL)";
+            instr << "LDI A,(HL)";
             break;
         case 0x3A:
             // LDD A,(HL)
-            instr._ss << "LDD A,(HL)";
+            instr << "LDD A,(HL)";
             break;
         case 0x03:
         case 0x13:
         case 0x23:
         case 0x33:
             // INC rp[p]
-            instr._ss << "INC " << _decode_rp[p];
+            instr << "INC " << DECODE_RP[p];
             break;
         case 0x0B:
         case 0x1B:
         case 0x2B:
         case 0x3B:
             // DEC rp[p]
-            instr._ss << "DEC " << _decode_rp[p];
+            instr << "DEC " << DECODE_RP[p];
             break;
         case 0x04:
         case 0x0C:
@@ -165,7 +293,7 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0x34:
         case 0x3C:
             // INC r[y]
-            instr._ss << "INC " << _decode_r[y];
+            instr << "INC " << DECODE_R[y];
             break;
         case 0x05:
         case 0x0D:
@@ -176,7 +304,7 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0x35:
         case 0x3D:
             // DEC r[y]
-            instr._ss << "DEC " << _decode_r[y];
+            instr << "DEC " << DECODE_R[y];
             break;
         case 0x06:
         case 0x0E:
@@ -187,40 +315,40 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0x36:
         case 0x3E:
             // LD r[y],n
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "LD " << _decode_r[y] << "," << Display8BumpPC();
+            instr.PushCodeByte(Read8PC());
+            instr << "LD " << DECODE_R[y] << "," << Display8BumpPC();
             break;
         case 0x07:
             // RLCA
-            instr._ss << "RLCA";
+            instr << "RLCA";
             break;
         case 0xF:
             // RRCA
-            instr._ss << "RRCA";
+            instr << "RRCA";
             break;
         case 0x17:
             // RLA
-            instr._ss << "RLA";
+            instr << "RLA";
             break;
         case 0x1F:
             // RRA
-            instr._ss << "RRA";
+            instr << "RRA";
             break;
         case 0x27:
             // DAA
-            instr._ss << "DAA";
+            instr << "DAA";
             break;
         case 0x2F:
             // CPL
-            instr._ss << "CPL";
+            instr << "CPL";
             break;
         case 0x37:
             // SCF
-            instr._ss << "SCF";
+            instr << "SCF";
             break;
         case 0x3F:
             // CCF
-            instr._ss << "CCF";
+            instr << "CCF";
             break;
         case 0x40:
         case 0x41:
@@ -287,11 +415,11 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0x7E:
         case 0x7F:
             // LD r[y],r[z]
-            instr._ss << "LD " << _decode_r[y] << "," << _decode_r[z];
+            instr << "LD " << DECODE_R[y] << "," << DECODE_R[z];
             break;
         case 0x76:
             // HALT
-            instr._ss << "HALT";
+            instr << "HALT";
             break;
         case 0x80:
         case 0x81:
@@ -358,122 +486,122 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0xBE:
         case 0xBF:
             // alu[y] r[z]
-            instr._ss << _decode_alu[y] << _decode_r[z];
+            instr << DECODE_ALU[y] << DECODE_R[z];
             break;
         case 0xC0:
         case 0xC8:
         case 0xD0:
         case 0xD8:
             // RET cc[y]
-            instr._ss << "RET " << _decode_cc[y];
+            instr << "RET " << DECODE_CC[y];
         break;
         case 0xE0:
             // LD ($FF00+n),A
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "LD ($FF00+" << Display8BumpPC() << "),A";
+            instr.PushCodeByte(Read8PC());
+            instr << "LD ($FF00+" << Display8BumpPC() << "),A";
             break;
         case 0xE8:
             // ADD SP,n
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "ADD SP," << Display8BumpPC();
+            instr.PushCodeByte(Read8PC());
+            instr << "ADD SP," << Display8BumpPC();
             break;
         case 0xF0:
             // LD A,($FF00+n)
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "LD A,($FF00+" << Display8BumpPC() << ")";
+            instr.PushCodeByte(Read8PC());
+            instr << "LD A,($FF00+" << Display8BumpPC() << ")";
             break;
         case 0xF8:
             // LDHL
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << "LDHL SP," << Display8BumpPC();
+            instr.PushCodeByte(Read8PC());
+            instr << "LDHL SP," << Display8BumpPC();
             break;
         case 0xC1:
         case 0xD1:
         case 0xE1:
         case 0xF1:
             // POP rp2[p]
-            instr._ss << "POP " << _decode_rp2[p];
+            instr << "POP " << DECODE_RP2[p];
             break;
         case 0xC9:
             // RET
-            instr._ss << "RET";
+            instr << "RET";
             break;
         case 0xD9:
             // RETI
-            instr._ss << "RETI";
+            instr << "RETI";
             break;
         case 0xE9:
             // JP HL
-            instr._ss << "JP HL";
+            instr << "JP HL";
             break;
         case 0xF9:
             // LD SP,HL
-            instr._ss << "LD SP,HL";
+            instr << "LD SP,HL";
             break;
         case 0xC2:
         case 0xCA:
         case 0xD2:
         case 0xDA:
             // JP cc[y],nn
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "JP " << _decode_cc[y] << "," << Display16BumpPC();
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "JP " << DECODE_CC[y] << "," << Display16BumpPC();
             break;
         case 0xE2:
             // LD ($FF00+C),A
-            instr._ss << "LD ($FF00+C),A";
+            instr << "LD ($FF00+C),A";
             break;
         case 0xEA:
             // LD (nn),A
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "LD (" << Display16BumpPC() << "),A";
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "LD (" << Display16BumpPC() << "),A";
             break;
         case 0xF2:
             // LD A,($FF00+C)
-            instr._ss << "LD A,($FF00+C)";
+            instr << "LD A,($FF00+C)";
             break;
         case 0xFA:
             // LD A,(nn)
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "LD A,(" << Display16BumpPC() << ")";
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "LD A,(" << Display16BumpPC() << ")";
             break;
         case 0xC3:
             // JP nn
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "JP " << Display16BumpPC();
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "JP " << Display16BumpPC();
             break;
         case 0xF3:
             // DI
-            instr._ss << "DI";
+            instr << "DI";
             break;
         case 0xFB:
             // EI
-            instr._ss << "EI";
+            instr << "EI";
             break;
         case 0xC4:
         case 0xCC:
         case 0xD4:
         case 0xDC:
             // CALL cc[y],nn
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "CALL " << _decode_cc[y] << "," << Display16BumpPC();
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "CALL " << DECODE_CC[y] << "," << Display16BumpPC();
             break;
         case 0xC5:
         case 0xD5:
         case 0xE5:
         case 0xF5:
             // PUSH rp2[p]
-            instr._ss << "PUSH " << _decode_rp2[p];
+            instr << "PUSH " << DECODE_RP2[p];
             break;
         case 0xCD:
             // CALL nn
-            instr._codeBytes.push_back(Read8(_pc));
-            instr._codeBytes.push_back(Read8(_pc + 1));
-            instr._ss << "CALL " << Display16BumpPC();
+            instr.PushCodeByte(Read8(_pc));
+            instr.PushCodeByte(Read8(_pc + 1));
+            instr << "CALL " << Display16BumpPC();
             break;
         case 0xC6:
         case 0xCE:
@@ -484,8 +612,8 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0xF6:
         case 0xFE:
             // alu[y] n
-            instr._codeBytes.push_back(Read8PC());
-            instr._ss << _decode_alu[y] << Display8BumpPC();
+            instr.PushCodeByte(Read8PC());
+            instr << DECODE_ALU[y] << Display8BumpPC();
             break;
         case 0xC7:
         case 0xCF:
@@ -496,10 +624,11 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         case 0xF7:
         case 0xFF:
             // RST y*8
-            instr._ss << "RST " << '$' << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << (y << 3);
+            instr << "RST " << Instruction::Hex8{ (u8)(y << 3) };
             break;
         default:
-            __debugbreak();
+            // D3 DB DD E3 E4 EB EC ED F4 FC FD, only met when decoding data
+            instr << "DB " << Instruction::Hex8{ op };
             break;
         }
     }
@@ -509,29 +638,37 @@ void Disassembler::Disassemble(u16 pc, Disassembler::Instruction& instr)
         {
         case 0x00:
             // rot[y] r[z]
-            instr._ss << _decode_rot[y] << " " << _decode_r[z];
+            instr << DECODE_ROT[y] << ' ' << DECODE_R[z];
             break;
         case 0x40:
             // BIT y,r[z]
-            instr._ss << "BIT" << y << "," <<_decode_r[z];
+            instr << "BIT " << (char)('0' + y) << "," << DECODE_R[z];
             break;
         case 0x80:
             // RES y,r[z]
-            instr._ss << "RES" << y << "," << _decode_r[z];
+            instr << "RES " << (char)('0' + y) << "," << DECODE_R[z];
             break;
         case 0xC0:
             // SET y,r[z]
-            instr._ss << "SET" << y << "," << _decode_r[z];
+            instr << "SET " << (char)('0' + y) << "," << DECODE_R[z];
             break;
         default:
             __debugbreak();
             break;
         }
     }
+
+    instr.FormatCodeBytes();
+    instr.DecodeFlow(pc);
 }
 
 u8 Disassembler::Read8(u16 addr)
 {
+    if (_code != nullptr)
+    {
+        return _code[(u16)(addr - _codePC)];
+    }
+
     return _mem->Load(addr);
 }
 
@@ -560,18 +697,14 @@ u16 Disassembler::Read16BumpPC()
     return word;
 }
 
-std::string Disassembler::Display8BumpPC()
+Disassembler::Instruction::Hex8 Disassembler::Display8BumpPC()
 {
-    std::stringstream ss;
-    ss << '$' << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << (int)Read8BumpPC();
-    return ss.str();
+    return Instruction::Hex8{ Read8BumpPC() };
 }
 
-std::string Disassembler::Display16BumpPC()
+Disassembler::Instruction::Hex16 Disassembler::Display16BumpPC()
 {
-    std::stringstream ss;
-    ss << '$' << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << (int)Read16BumpPC();
-    return ss.str();
+    return Instruction::Hex16{ Read16BumpPC() };
 }
 
 u16 Disassembler::GetBranchTarget()
@@ -580,9 +713,47 @@ u16 Disassembler::GetBranchTarget()
     return (u16)((i32)_pc + (i32)disp);
 }
 
-std::string Disassembler::DisplayBranchTarget()
+Disassembler::Instruction::Hex16 Disassembler::DisplayBranchTarget()
 {
-    std::stringstream ss;
-    ss << '$' << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << (int)GetBranchTarget();
-    return ss.str();
+    return Instruction::Hex16{ GetBranchTarget() };
+}
+
+DisassemblyCache::DisassemblyCache(u32 capacity)
+    : _disassembler(nullptr)
+    , _shift(31)
+    , _hits(0)
+    , _misses(0)
+{
+    while (_shift > 12 && (1u << (32 - _shift)) < capacity)
+    {
+        _shift--;
+    }
+
+    Entry empty;
+    empty.Key = 0;
+    empty.Valid = false;
+    _entries.resize((size_t)1 << (32 - _shift), empty);
+}
+
+DisassemblyCache::~DisassemblyCache()
+{
+}
+
+const Disassembler::Instruction& DisassemblyCache::Get(u16 pc, u16 bank, const u8 code[3])
+{
+    u32 key = ((u32)(pc >= 0x4000 && pc < 0x8000 ? bank : 0) << 16) | pc;
+
+    // Fibonacci hashing, so neighbouring addresses in different banks spread out
+    Entry& entry = _entries[(key * 0x9E3779B1u) >> _shift];
+    if (entry.Valid && entry.Key == key && memcmp(entry.Instr.CodeBytes(), code, entry.Instr.Length()) == 0)
+    {
+        _hits++;
+        return entry.Instr;
+    }
+
+    _misses++;
+    _disassembler.Disassemble(pc, code, entry.Instr);
+    entry.Key = key;
+    entry.Valid = true;
+    return entry.Instr;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 class MemoryMap;
 
+// Disassembles one instruction at a time into a fixed buffer, without touching
+// the heap, so tools can disassemble whole traces.
 class Disassembler
 {
 public:
@@ -9,15 +11,64 @@ public:
     {
         friend class Disassembler;
     public:
-        std::string GetFormattedCodeBytes();
-        std::string GetDisassemblyString();
+        static const u32 MAX_TEXT = 24;
+
+        // How the instruction passes on control, for tools that follow it
+        enum class Flow
+        {
+            None,
+            Jump,
+            ConditionalJump,
+            Call,               // including conditional calls and RST
+            Return,
+            ConditionalReturn,
+            IndirectJump,       // JP HL
+            Invalid,            // not an opcode, shown as a DB
+        };
+
+    public:
+        Instruction();
+
+        u8 Length() const { return _length; }
+        const u8* CodeBytes() const { return _code; }
+
+        Flow GetFlow() const { return _flow; }
+        // Where a jump or call goes
+        u16 Target() const { return _target; }
+
+        const char* GetFormattedCodeBytes() const { return _codeText; }
+        const char* GetDisassemblyString() const { return _text; }
+
+    private:
+        struct Hex8
+        {
+            u8 Value;
+        };
+
+        struct Hex16
+        {
+            u16 Value;
+        };
 
     private:
         void Reset();
+        void PushCodeByte(u8 val);
+        void FormatCodeBytes();
+        void DecodeFlow(u16 pc);
+
+        Instruction& operator <<(const char* str);
+        Instruction& operator <<(char c);
+        Instruction& operator <<(Hex8 val);
+        Instruction& operator <<(Hex16 val);
 
     private:
-        std::vector<u8> _codeBytes;
-        std::stringstream _ss;
+        u8 _code[3];
+        u8 _length;
+        u8 _textLength;
+        Flow _flow;
+        u16 _target;
+        char _text[MAX_TEXT];
+        char _codeText[10];
     };
 
 public:
@@ -26,6 +77,10 @@ public:
 
     void Disassemble(u16 pc, Instruction& instr);
 
+    // Decodes from code, the bytes at pc, rather than from memory, e.g. for
+    // instructions recorded in a trace. Needs no MemoryMap.
+    void Disassemble(u16 pc, const u8 code[3], Instruction& instr);
+
 private:
     u8 Read8(u16 addr);
     u16 Read16(u16 addr);
@@ -34,21 +89,50 @@ private:
     u8 Read8BumpPC();
     u16 Read16BumpPC();
 
-    std::string Display8BumpPC();
-    std::string Display16BumpPC();
+    Instruction::Hex8 Display8BumpPC();
+    Instruction::Hex16 Display16BumpPC();
 
     u16 GetBranchTarget();
-    std::string DisplayBranchTarget();
+    Instruction::Hex16 DisplayBranchTarget();
 
 private:
     std::shared_ptr<MemoryMap> _mem;
     u16 _pc;
 
+    const u8* _code;
+    u16 _codePC;
+};
+
+// Remembers decoded instructions by ROM bank and address, so disassembling the
+// same code over and over, as in a long trace, costs a lookup. Each entry keeps
+// its code bytes and is decoded again when they differ, which keeps it correct
+// for code in RAM. Direct mapped; a miss replaces whatever was in its slot.
+class DisassemblyCache
+{
+public:
+    // capacity is rounded up to a power of two, at most 1M entries
+    DisassemblyCache(u32 capacity);
+    virtual ~DisassemblyCache();
+
+    // bank is the ROM bank mapped at 4000 - 7FFF, and is ignored elsewhere
+    const Disassembler::Instruction& Get(u16 pc, u16 bank, const u8 code[3]);
+
+    u64 Hits() const { return _hits; }
+    u64 Misses() const { return _misses; }
+
 private:
-    std::vector<std::string> _decode_alu;
-    std::vector<std::string> _decode_r;
-    std::vector<std::string> _decode_rp;
-    std::vector<std::string> _decode_rp2;
-    std::vector<std::string> _decode_cc;
-    std::vector<std::string> _decode_rot;
+    struct Entry
+    {
+        u32 Key;
+        bool Valid;
+        Disassembler::Instruction Instr;
+    };
+
+private:
+    Disassembler _disassembler;
+    std::vector<Entry> _entries;
+    u32 _shift;
+
+    u64 _hits;
+    u64 _misses;
 };
\ No newline at end of file
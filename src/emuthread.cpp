@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "emuthread.h"
+#include "gameboy.h"
+#include "rewind.h"
+#include "screenbuffer.h"
+#include "audioring.h"
+#include <cmath>
+
+// How much the audio may be resampled to follow the display, and how far
+// behind the display emulation may fall before it stops trying to catch up
+static const double MAX_RATE_ADJUST = 0.005;
+static const u64 MAX_LAG_PRESENTS = 5;
+
+// Audio buffered ahead of the device
+static const u32 AUDIO_LATENCY_MS = 50;
+
+EmuThread::EmuThread(Gameboy& gameboy, const u32 palette[4], u32 runAheadFrames, bool rewind)
+    : _gameboy(gameboy)
+    , _runAhead(gameboy, runAheadFrames)
+    , _audio(nullptr)
+    , _audioTarget(0)
+    , _displayRate(0.0)
+    , _presents(0)
+    , _pacedFrames(0)
+    , _running(false)
+    , _finished(false)
+    , _buttons(0)
+    , _rewinding(false)
+    , _turbo(false)
+    , _appliedButtons(0)
+{
+    memcpy(_palette, palette, sizeof(_palette));
+
+    if (rewind)
+    {
+        // about one minute of history is kept
+        _rewind = std::make_unique<Rewind>(gameboy);
+    }
+}
+
+EmuThread::~EmuThread()
+{
+    Stop();
+}
+
+void EmuThread::Start()
+{
+    if (_running)
+    {
+        return;
+    }
+
+    _audio = _gameboy.GetAudioOutput();
+    if (_audio != nullptr)
+    {
+        _audioTarget = std::min(_audio->SampleRate() * AUDIO_LATENCY_MS / 1000, _audio->Capacity() / 2);
+    }
+
+    _running = true;
+    _thread = std::thread(&EmuThread::Run, this);
+}
+
+void EmuThread::Stop()
+{
+    _running = false;
+    _presentCondition.notify_one();
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+// Only display rates the audio can be resampled to follow are used for pacing
+void EmuThread::SetDisplayRate(double refreshRate)
+{
+    bool close = std::abs(refreshRate - FramePacer::FRAME_RATE) <= FramePacer::FRAME_RATE * MAX_RATE_ADJUST;
+    _displayRate = close ? refreshRate : 0.0;
+}
+
+void EmuThread::FramePresented()
+{
+    {
+        std::lock_guard<std::mutex> lock(_presentMutex);
+        _presents++;
+    }
+    _presentCondition.notify_one();
+}
+
+void EmuThread::Run()
+{
+    ResetPacing();
+
+    bool wasTurbo = false;
+    while (_running && !_gameboy.IsMovieFinished())
+    {
+        bool turbo = _turbo;
+        if (!turbo)
+        {
+            if (wasTurbo)
+            {
+                ResetPacing();
+            }
+
+            if (_audio != nullptr && _displayRate != 0.0)
+            {
+                WaitForDisplay();
+
+                // in case presents stop waiting for vsync, e.g. while minimized
+                WaitForAudio(_audioTarget * 2);
+                AdjustAudioRate();
+            }
+            else if (_audio != nullptr)
+            {
+                WaitForAudio(_audioTarget);
+            }
+            else
+            {
+                _pacer.Wait();
+            }
+        }
+        wasTurbo = turbo;
+
+        ApplyButtons();
+
+        if (_rewind && _rewinding)
+        {
+            // step back two frames and then render one forwards so there is something to show
+            _rewind->Step(2);
+        }
+
+        if (WantFrame(turbo))
+        {
+            Frame& frame = _frames.Back();
+            _runAhead.DoFrame(ScreenBuffer(frame.Pixels, sizeof(frame.Pixels[0]) * 160, _palette));
+            _frames.Publish();
+        }
+        else
+        {
+            _gameboy.DoFrame(nullptr);
+        }
+
+        if (_rewind)
+        {
+            _rewind->Capture();
+        }
+    }
+
+    _finished = _gameboy.IsMovieFinished();
+}
+
+void EmuThread::ResetPacing()
+{
+    _pacer.Reset();
+
+    std::lock_guard<std::mutex> lock(_presentMutex);
+    _pacedFrames = _presents;
+}
+
+// One frame is emulated per present, a frame that took too long is caught up
+// on the next refresh
+void EmuThread::WaitForDisplay()
+{
+    std::unique_lock<std::mutex> lock(_presentMutex);
+    _presentCondition.wait_for(lock, std::chrono::milliseconds(100), [this] {
+        return !_running || _presents > _pacedFrames;
+    });
+
+    if (_presents > _pacedFrames + MAX_LAG_PRESENTS)
+    {
+        _pacedFrames = _presents;
+    }
+    else
+    {
+        _pacedFrames++;
+    }
+}
+
+// Sleep until the device has played the ring down to fill frames
+void EmuThread::WaitForAudio(u32 fill)
+{
+    while (_running)
+    {
+        u32 available = _audio->Available();
+        if (available <= fill)
+        {
+            break;
+        }
+
+        u64 us = (u64)(available - fill) * 1000000 / _audio->SampleRate();
+        std::this_thread::sleep_for(std::chrono::microseconds(std::max<u64>(us, 1000)));
+    }
+}
+
+// Emulating at the display's rate produces audio at the wrong rate, correct for
+// that and then nudge the rate to keep the ring at its target fill
+void EmuThread::AdjustAudioRate()
+{
+    double fill = std::min<double>(_audio->Available(), _audioTarget * 2);
+    double adjust = 1.0 + MAX_RATE_ADJUST * (_audioTarget - fill) / _audioTarget;
+    _gameboy.SetAudioRateAdjust(FramePacer::FRAME_RATE / _displayRate * adjust);
+}
+
+// In turbo, frames are only rendered once the main thread has taken the last one
+// and a display frame has passed, the rest are run without rendering
+bool EmuThread::WantFrame(bool turbo)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (turbo)
+    {
+        if (_frames.HasFresh() || now - _lastFrameTime < std::chrono::duration<double>(1.0 / FramePacer::FRAME_RATE))
+        {
+            return false;
+        }
+    }
+
+    _lastFrameTime = now;
+    return true;
+}
+
+// Changes are only applied between frames so they land on a frame boundary
+void EmuThread::ApplyButtons()
+{
+    u8 buttons = _buttons;
+    u8 changed = buttons ^ _appliedButtons;
+    for (u8 i = 0; i < 8; i++)
+    {
+        if ((changed & (1 << i)) != 0)
+        {
+            _gameboy.Button(i, (buttons & (1 << i)) != 0);
+        }
+    }
+    _appliedButtons = buttons;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "pacer.h"
+#include "runahead.h"
+#include "triplebuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class Gameboy;
+class Rewind;
+class AudioRing;
+
+// Runs a Gameboy on its own thread so presentation stalls can't delay emulation.
+// Finished frames are handed to the main thread through a triple buffer. Input
+// is passed back as a button mask that the emulation thread applies at the start
+// of each frame, which keeps recorded movies independent of host timing.
+//
+// With sound, emulation is paced by the audio device rather than a timer. On a
+// vsynced display close to the Game Boy's rate, one frame is emulated per
+// refresh and the audio is resampled slightly to keep the output ring at its
+// target fill, so neither video nor audio stutters. Otherwise emulation waits
+// for the ring to drain to its target.
+class EmuThread
+{
+public:
+    struct Frame
+    {
+        u32 Pixels[160 * 144];
+    };
+
+public:
+    // Frames are rendered as 32-bit pixels looked up in palette
+    EmuThread(Gameboy& gameboy, const u32 palette[4], u32 runAheadFrames, bool rewind);
+    virtual ~EmuThread();
+
+    void Start();
+    void Stop();
+
+    // Bit n is the state of Gameboy::Button(n)
+    void SetButtons(u8 buttons) { _buttons = buttons; }
+    void SetRewinding(bool rewinding) { _rewinding = rewinding; }
+
+    // Run as fast as possible, only rendering as many frames as can be shown
+    void SetTurbo(bool turbo) { _turbo = turbo; }
+
+    // refreshRate is 0 without vsync. FramePresented is called after each present.
+    void SetDisplayRate(double refreshRate);
+    void FramePresented();
+
+    // True once a movie being played or recorded has reached its end
+    bool IsFinished() const { return _finished; }
+
+    // Returns true if a new frame was finished since the last call
+    bool AcquireFrame() { return _frames.Acquire(); }
+    const Frame& GetFrame() const { return _frames.Front(); }
+
+private:
+    void Run();
+    void ApplyButtons();
+    bool WantFrame(bool turbo);
+
+    void ResetPacing();
+    void WaitForDisplay();
+    void WaitForAudio(u32 fill);
+    void AdjustAudioRate();
+
+private:
+    Gameboy& _gameboy;
+    u32 _palette[4];
+    RunAhead _runAhead;
+    std::unique_ptr<Rewind> _rewind;
+    FramePacer _pacer;
+
+    AudioRing* _audio;
+    u32 _audioTarget;
+
+    double _displayRate;
+    std::mutex _presentMutex;
+    std::condition_variable _presentCondition;
+    u64 _presents;
+    u64 _pacedFrames;
+
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<bool> _finished;
+
+    std::atomic<u8> _buttons;
+    std::atomic<bool> _rewinding;
+    std::atomic<bool> _turbo;
+    u8 _appliedButtons;
+
+    std::chrono::steady_clock::time_point _lastFrameTime;
+
+    TripleBuffer<Frame> _frames;
+};
\ No newline at end of file
@@ -6,15 +6,30 @@
 #include "cart.h"
 #include "timer.h"
 #include "input.h"
+#include "apu.h"
+#include "state.h"
+#include "movie.h"
+#include "screenbuffer.h"
+#include "debugger.h"
+#include "trace.h"
+#include "profiler.h"
 
 Gameboy::Gameboy()
+    : _frame(0)
+    , _midFrame(false)
+    , _speculative(false)
+    , _moviePlaying(false)
+    , _movieIndex(0)
+    , _movieEventCycle(UINT32_MAX)
 {
+    _debugger = std::make_shared<Debugger>();
     _cart = std::make_shared<Cart>(*this);
     _memoryMap = std::make_shared<MemoryMap>(*this);
     _cpu = std::make_shared<Cpu>(*this);
     _video = std::make_shared<Video>(*this);
     _timer = std::make_shared<Timer>(*this);
     _input = std::make_shared<Input>(*this);
+    _apu = std::make_shared<Apu>(*this);
 }
 
 Gameboy::~Gameboy()
@@ -25,41 +40,473 @@ Gameboy::~Gameboy()
     _video->UnInit();
     _timer->UnInit();
     _input->UnInit();
+    _apu->UnInit();
 }
 
-void Gameboy::Init(std::unique_ptr<Rom> rom)
+bool Gameboy::Init(std::unique_ptr<Rom> rom)
 {
-    _cart->Init(std::move(rom));
+    if (!rom->Init())
+    {
+        return false;
+    }
+
+    InitShared(std::move(rom));
+    return true;
+}
+
+void Gameboy::InitShared(std::shared_ptr<const Rom> rom)
+{
+    _frame = 0;
+    _midFrame = false;
+
+    _cart->Init(rom);
     _memoryMap->Init();
     _cpu->Init();
     _video->Init();
     _timer->Init();
     _input->Init();
+    _apu->Init();
 }
 
-static u8 scroll = 0;
-
 void Gameboy::DoFrame(u8 gbScreen[])
 {
-    memset(gbScreen, 0, 160 * 144);
-    _video->SetScreen(gbScreen);
-    scroll++;
-    u32 cycles = 0;
-    bool vblank = false;
+    DoFrame(ScreenBuffer(gbScreen));
+}
+
+void Gameboy::DoFrame(const ScreenBuffer& screen)
+{
+    Run(screen, 1, []() { return false; });
+}
+
+void Gameboy::RunCycles(u32 cycles, const ScreenBuffer& screen)
+{
+    u64 end = _cpu->GetTotalCycles() + cycles;
+    Run(screen, UINT32_MAX, [this, end]() {
+        return _cpu->GetTotalCycles() >= end;
+    });
+}
+
+bool Gameboy::RunUntilPC(u16 pc, u32 maxFrames, const ScreenBuffer& screen)
+{
+    return Run(screen, maxFrames, [this, pc]() {
+        return _cpu->GetPC() == pc;
+    });
+}
+
+// A temporary write watchpoint, unless one was already set
+bool Gameboy::RunUntilWrite(u16 addr, u32 maxFrames, const ScreenBuffer& screen)
+{
+    bool existing = _debugger->HasWatchpoint(addr, Debugger::Access::Write);
+    _debugger->AddWatchpoint(addr, Debugger::Access::Write);
+    Run(screen, maxFrames, []() { return false; });
+    if (!existing)
+    {
+        _debugger->RemoveWatchpoint(addr, Debugger::Access::Write);
+    }
+
+    const Debugger::WatchHit& watch = _debugger->LastWatch();
+    return _debugger->GetStopReason() == Debugger::StopReason::Watchpoint &&
+           watch.Addr == addr && watch.Type == Debugger::Access::Write;
+}
+
+bool Gameboy::RunUntilScanline(u8 line, u32 maxFrames, const ScreenBuffer& screen)
+{
+    u8 last = _video->Line();
+    return Run(screen, maxFrames, [this, line, &last]() {
+        u8 ly = _video->Line();
+        bool hit = ly == line && last != line;
+        last = ly;
+        return hit;
+    });
+}
+
+// Runs until stop returns true after an instruction or frames frames have
+// ended. DoFrame's stop is constant, so its loop compiles to what it always
+// was, and the debugger's checks are only compiled into a second copy.
+template <typename Stop>
+bool Gameboy::Run(const ScreenBuffer& screen, u32 frames, Stop stop)
+{
+    if (_debugger->Armed())
+    {
+        _debugger->BeginRun();
+        return RunFrames<true>(screen, frames, stop);
+    }
+
+    return RunFrames<false>(screen, frames, stop);
+}
+
+template <bool Debug, typename Stop>
+bool Gameboy::RunFrames(const ScreenBuffer& screen, u32 frames, Stop stop)
+{
+    while (frames != 0)
+    {
+        if (_midFrame)
+        {
+            _video->ResumeScreen(screen);
+        }
+        else
+        {
+            BeginFrame(screen);
+        }
+
+        bool vblank = false;
+        bool stopped = false;
+        bool broke = false;
+        do
+        {
+            if (_cpu->GetCycles() >= _movieEventCycle)
+            {
+                ApplyMovieEvents();
+            }
+
+            _cpu->Step();
+            _timer->Step();
+            vblank = _video->Step();
+            stopped = stop();
+            broke = Debug && _debugger->ShouldStop(_cpu->GetPC());
+        } while (!vblank && !stopped && !broke);
+
+        if (vblank)
+        {
+            EndFrame();
+            frames--;
+        }
+
+        if (stopped || broke)
+        {
+            return stopped;
+        }
+    }
+
+    return false;
+}
+
+void Gameboy::BeginFrame(const ScreenBuffer& screen)
+{
+    _video->SetScreen(screen);
     _video->BeforeFrame();
     _timer->BeforeFrame();
+    _apu->BeforeFrame();
     _cpu->BeforeFrame();
-    do
+    _midFrame = true;
+    SetNextMovieEvent();
+}
+
+void Gameboy::EndFrame()
+{
+    _apu->EndFrame();
+    if (!_speculative)
     {
-        _cpu->Step();
-        //_video->SCX = 0x11;
-        //_video->SCY = scroll;
-        _timer->Step();
-        vblank = _video->Step();
-    } while (!vblank);
+        _cart->EndFrame();
+    }
+    _midFrame = false;
+    _frame++;
+    _perfCounters.Frames++;
 }
 
 void Gameboy::Button(u8 idx, bool pressed)
 {
+    if (_movie)
+    {
+        if (_moviePlaying)
+        {
+            return;
+        }
+
+        _movie->AddEvent(_frame, _midFrame ? _cpu->GetCycles() : 0, idx, pressed);
+    }
+
     _input->Button(idx, pressed);
+}
+
+u8 Gameboy::Peek(u16 addr)
+{
+    return _memoryMap->Peek(addr);
+}
+
+u32 Gameboy::WramPageCount() const
+{
+    return _memoryMap->WramPageCount();
+}
+
+const u8* Gameboy::WramPage(u32 index) const
+{
+    return _memoryMap->WramPage(index);
+}
+
+const u8* Gameboy::Hram() const
+{
+    return _memoryMap->Hram();
+}
+
+void Gameboy::StartTrace(u32 capacity)
+{
+    StopTrace();
+    _trace = std::make_unique<TraceBuffer>();
+    _trace->Create(capacity);
+    _cpu->SetTrace(_trace.get());
+}
+
+bool Gameboy::StartTrace(const char* path, u32 capacity)
+{
+    StopTrace();
+    _trace = std::make_unique<TraceBuffer>();
+    if (!_trace->Create(path, capacity))
+    {
+        _trace = nullptr;
+        return false;
+    }
+
+    _cpu->SetTrace(_trace.get());
+    return true;
+}
+
+void Gameboy::StopTrace()
+{
+    _cpu->SetTrace(nullptr);
+    if (_trace)
+    {
+        _trace->Flush();
+    }
+}
+
+void Gameboy::StartProfile()
+{
+    _profiler = std::make_unique<Profiler>(_cart->GetRom());
+    _cpu->SetProfiler(_profiler.get());
+}
+
+void Gameboy::StopProfile()
+{
+    _cpu->SetProfiler(nullptr);
+}
+
+bool Gameboy::OpenSaveFile(const char* path)
+{
+    return _cart->OpenSaveFile(path);
+}
+
+void Gameboy::SetSpeculative(bool speculative)
+{
+    _speculative = speculative;
+}
+
+void Gameboy::SetAudioOutput(AudioRing* output)
+{
+    _apu->SetOutput(output);
+}
+
+AudioRing* Gameboy::GetAudioOutput() const
+{
+    return _apu->GetOutput();
+}
+
+void Gameboy::MuteAudio(bool muted)
+{
+    _apu->SetMuted(muted);
+}
+
+void Gameboy::SetAudioRateAdjust(double ratio)
+{
+    _apu->SetRateAdjust(ratio);
+}
+
+u64 Gameboy::StateHash()
+{
+    std::vector<u8> state = SaveState();
+    return Movie::Hash(&state[0], state.size());
+}
+
+void Gameboy::RecordMovie(std::shared_ptr<Movie> movie)
+{
+    std::shared_ptr<const Rom> rom = _cart->GetRom();
+
+    movie->Clear();
+    movie->RomHash = Movie::Hash(rom->Data(), rom->Size());
+    movie->StartState = SaveState();
+
+    _movie = movie;
+    _moviePlaying = false;
+}
+
+bool Gameboy::PlayMovie(std::shared_ptr<Movie> movie)
+{
+    std::shared_ptr<const Rom> rom = _cart->GetRom();
+    if (movie->RomHash != Movie::Hash(rom->Data(), rom->Size()))
+    {
+        return false;
+    }
+
+    if (!LoadState(movie->StartState.data(), movie->StartState.size()))
+    {
+        return false;
+    }
+
+    _movie = movie;
+    _moviePlaying = true;
+    SeekMovie();
+    return true;
+}
+
+void Gameboy::StopMovie()
+{
+    if (_movie && !_moviePlaying)
+    {
+        _movie->EndFrame = _frame;
+        _movie->FinalStateHash = StateHash();
+    }
+
+    _movie = nullptr;
+    _moviePlaying = false;
+    _movieEventCycle = UINT32_MAX;
+}
+
+bool Gameboy::IsMovieFinished() const
+{
+    return _moviePlaying && _frame >= _movie->EndFrame;
+}
+
+// Loading a state while playing (run-ahead, rewind) moves the frame counter
+void Gameboy::SeekMovie()
+{
+    const std::vector<Movie::Event>& events = _movie->Events();
+    std::vector<Movie::Event>::const_iterator it = std::lower_bound(events.begin(), events.end(), _frame,
+        [](const Movie::Event& event, u32 frame) {
+        return event.Frame < frame;
+    });
+    _movieIndex = it - events.begin();
+
+    // a frame is only begun once, so a state saved part way through needs its next event now
+    if (_midFrame)
+    {
+        SetNextMovieEvent();
+    }
+}
+
+void Gameboy::SetNextMovieEvent()
+{
+    _movieEventCycle = UINT32_MAX;
+    if (_moviePlaying)
+    {
+        const std::vector<Movie::Event>& events = _movie->Events();
+        if (_movieIndex < events.size() && events[_movieIndex].Frame == _frame)
+        {
+            _movieEventCycle = events[_movieIndex].Cycle;
+        }
+    }
+}
+
+void Gameboy::ApplyMovieEvents()
+{
+    const std::vector<Movie::Event>& events = _movie->Events();
+    while (_movieIndex < events.size() &&
+           events[_movieIndex].Frame == _frame &&
+           events[_movieIndex].Cycle <= _cpu->GetCycles())
+    {
+        _input->Button(events[_movieIndex].Button, events[_movieIndex].Pressed != 0);
+        _movieIndex++;
+    }
+
+    SetNextMovieEvent();
+}
+
+size_t Gameboy::SaveStateSize()
+{
+    StateStream state(StateStream::Mode::Measure, nullptr, 0);
+    Serialize(state);
+    return sizeof(StateHeader) + state.Position();
+}
+
+size_t Gameboy::SaveState(u8* buffer, size_t size)
+{
+    if (size < sizeof(StateHeader))
+    {
+        return 0;
+    }
+
+    StateStream state(StateStream::Mode::Save, buffer + sizeof(StateHeader), size - sizeof(StateHeader));
+    Serialize(state);
+    if (!state.Ok())
+    {
+        return 0;
+    }
+
+    StateHeader header;
+    header.Magic = STATE_MAGIC;
+    header.Version = STATE_VERSION;
+    header.HeaderSize = sizeof(StateHeader);
+    header.Size = (u32)(sizeof(StateHeader) + state.Position());
+    header.Reserved = 0;
+    memcpy(buffer, &header, sizeof(StateHeader));
+
+    return header.Size;
+}
+
+std::vector<u8> Gameboy::SaveState()
+{
+    std::vector<u8> buffer(SaveStateSize());
+    SaveState(&buffer[0], buffer.size());
+    return buffer;
+}
+
+bool Gameboy::LoadState(const u8* buffer, size_t size)
+{
+    if (size < sizeof(StateHeader))
+    {
+        return false;
+    }
+
+    StateHeader header;
+    memcpy(&header, buffer, sizeof(StateHeader));
+    if (header.Magic != STATE_MAGIC ||
+        header.Version != STATE_VERSION ||
+        header.HeaderSize != sizeof(StateHeader) ||
+        header.Size > size ||
+        header.Size != SaveStateSize())
+    {
+        return false;
+    }
+
+    // the layout has been validated against this instance, so loading cannot run short
+    StateStream state(StateStream::Mode::Load, const_cast<u8*>(buffer) + sizeof(StateHeader), header.Size - sizeof(StateHeader));
+    Serialize(state);
+
+    if (_moviePlaying)
+    {
+        SeekMovie();
+    }
+
+    return state.Ok();
+}
+
+std::unique_ptr<Gameboy> Gameboy::Fork()
+{
+    std::unique_ptr<Gameboy> child = std::make_unique<Gameboy>();
+    child->InitShared(_cart->GetRom());
+
+    std::vector<PagedMemory*> shared;
+    StateStream measure(StateStream::Mode::Measure, nullptr, 0, &shared);
+    Serialize(measure);
+
+    std::vector<u8> buffer(measure.Position());
+    StateStream save(StateStream::Mode::Save, &buffer[0], buffer.size(), &shared);
+    Serialize(save);
+
+    StateStream load(StateStream::Mode::Load, &buffer[0], buffer.size(), &shared);
+    child->Serialize(load);
+
+    return child;
+}
+
+void Gameboy::Serialize(StateStream& state)
+{
+    state.Value(_frame);
+    state.Value(_midFrame);
+    _cpu->Serialize(state);
+    _memoryMap->Serialize(state);
+    _video->Serialize(state);
+    _timer->Serialize(state);
+    _input->Serialize(state);
+    _apu->Serialize(state);
+    _cart->Serialize(state);
 }
\ No newline at end of file
@@ -1,12 +1,22 @@
 #pragma once
 
+#include "perfcounters.h"
+
 class Cpu;
 class Video;
 class MemoryMap;
 class Cart;
 class Timer;
 class Input;
+class Apu;
+class Debugger;
+class TraceBuffer;
+class Profiler;
+class AudioRing;
 class Rom;
+class StateStream;
+class Movie;
+struct ScreenBuffer;
 
 class Gameboy
 {
@@ -16,17 +26,119 @@ class Gameboy
     friend class Cart;
     friend class Timer;
     friend class Input;
+    friend class Apu;
 
 public:
     Gameboy();
     virtual ~Gameboy();
 
-    void Init(std::unique_ptr<Rom> rom);
+    bool Init(std::unique_ptr<Rom> rom);
+
+    // rom must already be initialized, and may be shared between instances
+    void InitShared(std::shared_ptr<const Rom> rom);
 
+    // Rendering is skipped entirely when gbScreen is nullptr
     void DoFrame(u8 gbScreen[]);
+    void DoFrame(const ScreenBuffer& screen);
+
+    // Finer stepping for tools. These share DoFrame's loop and stop on an
+    // instruction boundary, possibly part way through a frame. Any of them,
+    // or DoFrame, carries on from there; lines already drawn this frame went
+    // to the screen given when they were drawn. The RunUntil calls give up
+    // once maxFrames frames have ended and return whether they were stopped
+    // by their condition.
+    void RunCycles(u32 cycles, const ScreenBuffer& screen);
+    // Stops with pc about to execute
+    bool RunUntilPC(u16 pc, u32 maxFrames, const ScreenBuffer& screen);
+    // Stops after the instruction that writes addr, including OAM DMA
+    bool RunUntilWrite(u16 addr, u32 maxFrames, const ScreenBuffer& screen);
+    // Stops as soon as LY becomes line
+    bool RunUntilScanline(u8 line, u32 maxFrames, const ScreenBuffer& screen);
+    bool IsMidFrame() const { return _midFrame; }
+
+    // Breakpoints and watchpoints also stop DoFrame and the Run calls, which
+    // then return false. The debugger says why. They are not part of the
+    // state, and aren't copied by Fork.
+    Debugger& GetDebugger() { return *_debugger; }
+
+    // Traces every instruction into a ring of the last capacity of them, in
+    // memory or in a file at path that survives a crash. After stopping, the
+    // trace stays readable until the next start.
+    void StartTrace(u32 capacity);
+    bool StartTrace(const char* path, u32 capacity);
+    void StopTrace();
+    const TraceBuffer* GetTrace() const { return _trace.get(); }
+
+    // Counts cycles per guest PC and call stack. After stopping, the profile
+    // stays readable until the next start.
+    void StartProfile();
+    void StopProfile();
+    const Profiler* GetProfiler() const { return _profiler.get(); }
+
+    // Host side hot path counters since this instance was created. They stay
+    // zero unless built with PERF_COUNTERS.
+    const PerfCounters& GetPerfCounters() const { return _perfCounters; }
 
     void Button(u8 idx, bool pressed);
 
+    // Reads the memory map without trapping on unmapped addresses
+    u8 Peek(u16 addr);
+
+    // Zero-copy views of work RAM (C000 - DFFF, in pages) and high RAM
+    // (FF80 - FFFE). They are valid until the next frame, state load or fork.
+    u32 WramPageCount() const;
+    const u8* WramPage(u32 index) const;
+    const u8* Hram() const;
+
+    // Battery backed cart RAM is persisted to a memory-mapped file at path.
+    // Fails if the cart has no battery.
+    bool OpenSaveFile(const char* path);
+
+    // Speculative frames are undone by loading a state, so they leave the save
+    // file alone. What they wrote stays dirty for the next real frame to sync.
+    void SetSpeculative(bool speculative);
+
+    // Audio
+    // Sound is only synthesized while there is an output and it isn't muted
+    void SetAudioOutput(AudioRing* output);
+    AudioRing* GetAudioOutput() const;
+    void MuteAudio(bool muted);
+    void SetAudioRateAdjust(double ratio);
+
+    // Save States
+    size_t SaveStateSize();
+    size_t SaveState(u8* buffer, size_t size);
+    std::vector<u8> SaveState();
+    bool LoadState(const u8* buffer, size_t size);
+
+    // Creates a new instance in the same state as this one. Memory pages are shared
+    // copy-on-write, so forking costs little more than copying the registers.
+    std::unique_ptr<Gameboy> Fork();
+
+    u32 GetFrame() const { return _frame; }
+    u64 StateHash();
+
+    // Movies
+    // Recording captures the current state and then every Button call.
+    // While playing, Button calls from the host are ignored.
+    void RecordMovie(std::shared_ptr<Movie> movie);
+    bool PlayMovie(std::shared_ptr<Movie> movie);
+    void StopMovie();
+    bool IsMovieFinished() const;
+
+private:
+    template <typename Stop>
+    bool Run(const ScreenBuffer& screen, u32 frames, Stop stop);
+    template <bool Debug, typename Stop>
+    bool RunFrames(const ScreenBuffer& screen, u32 frames, Stop stop);
+    void BeginFrame(const ScreenBuffer& screen);
+    void EndFrame();
+
+    void Serialize(StateStream& state);
+    void ApplyMovieEvents();
+    void SetNextMovieEvent();
+    void SeekMovie();
+
 private:
     std::shared_ptr<Cpu> _cpu;
     std::shared_ptr<Video> _video;
@@ -34,4 +146,21 @@ private:
     std::shared_ptr<Cart> _cart;
     std::shared_ptr<Timer> _timer;
     std::shared_ptr<Input> _input;
+    std::shared_ptr<Apu> _apu;
+    std::shared_ptr<Debugger> _debugger;
+    std::unique_ptr<TraceBuffer> _trace;
+    std::unique_ptr<Profiler> _profiler;
+
+    // written by the components through the PERF_ macros
+    mutable PerfCounters _perfCounters;
+
+    // emulated frames since power on
+    u32 _frame;
+    bool _midFrame;
+    bool _speculative;
+
+    std::shared_ptr<Movie> _movie;
+    bool _moviePlaying;
+    size_t _movieIndex;
+    u32 _movieEventCycle;
 };
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "stdafx.h"
+#include "trace.h"
+#include "disassembler.h"
+#include "analyzer.h"
+#include "blipbuffer.h"
+#include "cart.h"
+#include "gameboy.h"
+#include "screenbuffer.h"
+#include "symbols.h"
+#include "threadpool.h"
+#include <chrono>
+
+static void Usage()
+{
+    printf("Usage: gbtool <command> [arguments]\n");
+    printf("  trace <file> [count]  disassemble the last count instructions of a trace, or all of them\n");
+    printf("  analyze <rom> [file]  find the code in a ROM, and write its basic blocks to file\n");
+    printf("  stepcheck <rom> [n]   check that stepping part way through frames renders the same n frames as whole frames\n");
+    printf("  blipcheck             check that frames longer than the sample buffer drop samples without overrunning it\n");
+}
+
+static int DumpTrace(const char* path, u32 count)
+{
+    TraceBuffer trace;
+    if (!trace.Open(path))
+    {
+        printf("Error: Could not open trace %s.\n", path);
+        return -1;
+    }
+
+    // a trace runs the same code over and over
+    DisassemblyCache disassembly(1 << 16);
+
+    u32 size = trace.Size();
+    for (u32 i = count < size ? size - count : 0; i < size; i++)
+    {
+        const TraceRecord& record = trace.Get(i);
+        const Disassembler::Instruction& instr = disassembly.Get(record.PC, record.Bank, record.Code);
+
+        printf(
+            "%12llu %02X:%04X %-14s %-18s AF:%04X BC:%04X DE:%04X HL:%04X SP:%04X\n",
+            (unsigned long long)record.Cycle,
+            record.PC < 0x4000 ? 0 : record.Bank,
+            record.PC,
+            instr.GetFormattedCodeBytes(),
+            instr.GetDisassemblyString(),
+            record.AF,
+            record.BC,
+            record.DE,
+            record.HL,
+            record.SP
+            );
+    }
+
+    return 0;
+}
+
+// Labels come from a .sym file next to the ROM, if there is one
+static int AnalyzeRom(const char* romPath, const char* listingPath)
+{
+    std::shared_ptr<Rom> rom = std::make_shared<MappedRom>(romPath);
+    if (!rom->Init())
+    {
+        printf("Error: Could not load ROM %s.\n", romPath);
+        return -1;
+    }
+
+    ThreadPool pool(0);
+    RomAnalyzer analyzer(rom);
+
+    auto start = std::chrono::steady_clock::now();
+    analyzer.Analyze(pool);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    u32 total = 0;
+    for (u32 bank = 0; bank < analyzer.BankCount(); bank++)
+    {
+        u32 code = analyzer.CodeBytes(bank);
+        if (code != 0)
+        {
+            printf("bank %02X: %5u code bytes\n", bank, code);
+        }
+        total += code;
+    }
+    printf("%u banks, %u code bytes, %u blocks, %u unresolved far jumps, %.1f ms on %u threads\n",
+        analyzer.BankCount(),
+        total,
+        (u32)analyzer.Blocks().size(),
+        analyzer.UnresolvedCount(),
+        ms,
+        pool.ThreadCount());
+
+    if (listingPath != nullptr)
+    {
+        std::string symPath = romPath;
+        size_t dot = symPath.find_last_of('.');
+        size_t slash = symPath.find_last_of("/\\");
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        {
+            symPath.resize(dot);
+        }
+
+        SymbolTable symbols;
+        symbols.Load((symPath + ".sym").c_str());
+        if (!analyzer.SaveListing(listingPath, symbols))
+        {
+            printf("Error: Could not write %s.\n", listingPath);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// One instance runs whole frames and the other runs the first part of each
+// frame in uneven RunCycles chunks before finishing it, for every screen
+// layout. Their screens and states must match after every frame.
+static int CheckStepping(const char* romPath, u32 frames)
+{
+    std::shared_ptr<Rom> rom = std::make_shared<MappedRom>(romPath);
+    if (!rom->Init())
+    {
+        printf("Error: Could not load ROM %s.\n", romPath);
+        return -1;
+    }
+
+    struct Layout
+    {
+        ScreenBuffer::Format Format;
+        u32 Scale;
+    };
+    static const Layout LAYOUTS[] =
+    {
+        { ScreenBuffer::Format::Shade8, 1 },
+        { ScreenBuffer::Format::Gray8, 1 },
+        { ScreenBuffer::Format::Shade8, 2 },
+        { ScreenBuffer::Format::Gray8, 2 },
+        { ScreenBuffer::Format::Shade8, 4 },
+        { ScreenBuffer::Format::Gray8, 4 },
+    };
+
+    // well short of the 70224 cycles in a frame, so the chunks never finish one
+    static const u32 CHUNKED_CYCLES = 60000;
+
+    int result = 0;
+    for (const Layout& layout : LAYOUTS)
+    {
+        Gameboy whole;
+        Gameboy chunked;
+        whole.InitShared(rom);
+        chunked.InitShared(rom);
+
+        std::vector<u8> wholePixels(ScreenBuffer::WIDTH * ScreenBuffer::HEIGHT);
+        std::vector<u8> chunkedPixels(ScreenBuffer::WIDTH * ScreenBuffer::HEIGHT);
+
+        u32 seed = 1;
+        u32 mismatches = 0;
+        for (u32 frame = 0; frame < frames; frame++)
+        {
+            whole.DoFrame(ScreenBuffer(&wholePixels[0], layout.Format, layout.Scale));
+
+            u32 cycles = 0;
+            for (;;)
+            {
+                seed = seed * 1103515245 + 12345;
+                u32 chunk = 1 + (seed >> 16) % 2000;
+                if (cycles + chunk > CHUNKED_CYCLES)
+                {
+                    break;
+                }
+
+                // a new buffer for every call, as a caller through the C API gets
+                chunked.RunCycles(chunk, ScreenBuffer(&chunkedPixels[0], layout.Format, layout.Scale));
+                cycles += chunk;
+            }
+            chunked.DoFrame(ScreenBuffer(&chunkedPixels[0], layout.Format, layout.Scale));
+
+            if (wholePixels != chunkedPixels || whole.StateHash() != chunked.StateHash())
+            {
+                mismatches++;
+            }
+        }
+
+        printf("%s scale %u: %u of %u frames differ\n",
+            layout.Format == ScreenBuffer::Format::Gray8 ? "gray" : "shade",
+            layout.Scale,
+            mismatches,
+            frames);
+        if (mismatches != 0)
+        {
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+// A caller that stops reading samples, or runs a long frame, leaves EndFrame
+// with more samples than the buffer holds. It must drop the oldest ones and
+// keep working; build with a memory checker to catch it reading past the end.
+static int CheckBlipOverflow()
+{
+    static const u32 CLOCK_RATE = 4194304;
+    static const u32 SAMPLE_RATE = 48000;
+    static const u32 MAX_SAMPLES = 4800;
+    static const u32 FRAME = CLOCK_RATE / 60;
+
+    struct Case
+    {
+        const char* Name;
+        u32 Time;
+    };
+    static const Case CASES[] =
+    {
+        { "one frame", FRAME },
+        { "just over the buffer", CLOCK_RATE / 10 + FRAME },
+        { "twice the buffer", CLOCK_RATE / 5 },
+        { "two seconds", CLOCK_RATE * 2 },
+    };
+
+    std::vector<i16> samples(MAX_SAMPLES * 2);
+
+    int result = 0;
+    for (const Case& c : CASES)
+    {
+        BlipBuffer buffer;
+        buffer.SetRates(CLOCK_RATE, SAMPLE_RATE, MAX_SAMPLES);
+
+        buffer.AddDelta(0, 1000);
+        buffer.AddDelta(c.Time - 100, -1000);
+        buffer.EndFrame(c.Time);
+        u32 available = buffer.SamplesAvailable();
+        bool ok = available <= MAX_SAMPLES && buffer.ReadSamples(&samples[0], available, 1) == available;
+
+        // the next frame after a drop plays as usual
+        buffer.AddDelta(0, 1000);
+        buffer.EndFrame(FRAME);
+        u32 next = buffer.SamplesAvailable();
+        ok = ok && next + 1 >= SAMPLE_RATE / 60 && buffer.ReadSamples(&samples[0], next, 1) == next;
+        ok = ok && buffer.SamplesAvailable() == 0;
+
+        printf("%s: %u samples kept, %s\n", c.Name, available, ok ? "ok" : "FAILED");
+        if (!ok)
+        {
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 3 && strcmp(argv[1], "trace") == 0)
+    {
+        return DumpTrace(argv[2], argc >= 4 ? (u32)strtoul(argv[3], nullptr, 10) : UINT32_MAX);
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "analyze") == 0)
+    {
+        return AnalyzeRom(argv[2], argc >= 4 ? argv[3] : nullptr);
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "stepcheck") == 0)
+    {
+        return CheckStepping(argv[2], argc >= 4 ? (u32)strtoul(argv[3], nullptr, 10) : 300);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "blipcheck") == 0)
+    {
+        return CheckBlipOverflow();
+    }
+
+    Usage();
+    return -1;
+}
\ No newline at end of file
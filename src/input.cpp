@@ -1,10 +1,12 @@
 #include "stdafx.h"
 #include "input.h"
 #include "gameboy.h"
+#include "state.h"
 
 Input::Input(const Gameboy& gameboy)
     : _gameboy(gameboy)
     , _cpu(nullptr)
+    , _p1(0)
 {
 }
 
@@ -25,6 +27,13 @@ void Input::UnInit()
     _cpu = nullptr;
 }
 
+void Input::Serialize(StateStream& state)
+{
+    state.Value(_p1);
+    state.Value(_buttons);
+    state.Value(_dpad);
+}
+
 u8 Input::Load()
 {
     //return _p1 | 0b11001111;
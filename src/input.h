@@ -2,6 +2,7 @@
 
 class Gameboy;
 class Cpu;
+class StateStream;
 
 class Input
 {
@@ -12,6 +13,8 @@ public:
     void Init();
     void UnInit();
 
+    void Serialize(StateStream& state);
+
     u8 Load();
     void Store(u8 val);
 
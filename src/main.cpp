@@ -1,29 +1,250 @@
 #include "stdafx.h"
 #include "gameboy.h"
 #include "cart.h"
+#include "emuthread.h"
+#include "movie.h"
+#include "profiler.h"
+#include "symbols.h"
+#include "SdlAudio.h"
 #include "SdlGfx.h"
 #include "SdlInput.h"
 
+static void Usage()
+{
+    printf("Usage: gameboy [options] <rom>\n");
+    printf("  --rewind          keep rewind history, hold backspace to rewind\n");
+    printf("  --turbo           run as fast as possible, hold tab to do so temporarily\n");
+    printf("  --runahead <n>    emulate n frames ahead to hide input lag\n");
+    printf("  --record <movie>  record input to a movie file\n");
+    printf("  --play <movie>    replay a movie file\n");
+    printf("  --headless        with --play, replay unthrottled without a window and verify the final state\n");
+    printf("  --trace <file>    keep the last million instructions in a binary trace file, read it with gbtool\n");
+    printf("  --profile <file>  count cycles per guest routine, writing flamegraph stacks to file and hot spots to file.txt\n");
+}
+
+static const u32 TRACE_CAPACITY = 1 << 20;
+
+// The ROM's path with its extension replaced by extension
+static std::string RomSibling(const char* romPath, const char* extension)
+{
+    std::string path = romPath;
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        path.resize(dot);
+    }
+    return path + extension;
+}
+
+// Labels come from a .sym file next to the ROM, if there is one
+static void SaveProfile(Gameboy& gameboy, const char* romPath, const char* profilePath)
+{
+    gameboy.StopProfile();
+
+    SymbolTable symbols;
+    symbols.Load(RomSibling(romPath, ".sym").c_str());
+
+    const Profiler* profiler = gameboy.GetProfiler();
+    std::string hotSpotsPath = std::string(profilePath) + ".txt";
+    if (!profiler->SaveCollapsed(profilePath, symbols) || !profiler->SaveHotSpots(hotSpotsPath.c_str(), symbols, 100))
+    {
+        printf("Error: Could not save profile %s.\n", profilePath);
+    }
+}
+
+static int PlayHeadless(Gameboy& gameboy, std::shared_ptr<Movie> movie)
+{
+    u8 gbScreen[160 * 144] = { 0 };
+
+    while (!gameboy.IsMovieFinished())
+    {
+        gameboy.DoFrame(gbScreen);
+    }
+
+    u64 hash = gameboy.StateHash();
+    bool match = hash == movie->FinalStateHash;
+    printf("frames: %u state: %016llX expected: %016llX %s\n",
+        gameboy.GetFrame(),
+        (unsigned long long)hash,
+        (unsigned long long)movie->FinalStateHash,
+        match ? "MATCH" : "MISMATCH");
+
+#ifdef PERF_COUNTERS
+    gameboy.GetPerfCounters().Report(stdout, PerfCounters());
+#endif
+
+    return match ? 0 : 1;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc < 2)
+    const char* romPath = nullptr;
+    const char* recordPath = nullptr;
+    const char* playPath = nullptr;
+    const char* tracePath = nullptr;
+    const char* profilePath = nullptr;
+    bool rewindEnabled = false;
+    bool turbo = false;
+    bool headless = false;
+    u32 runAheadFrames = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--rewind") == 0)
+        {
+            rewindEnabled = true;
+        }
+        else if (strcmp(argv[i], "--turbo") == 0)
+        {
+            turbo = true;
+        }
+        else if (strcmp(argv[i], "--runahead") == 0 && i + 1 < argc)
+        {
+            runAheadFrames = (u32)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+        {
+            playPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profilePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else
+        {
+            romPath = argv[i];
+        }
+    }
+
+    if (romPath == nullptr || (headless && playPath == nullptr))
     {
         printf("Error: Must pass path to ROM file.\n");
+        Usage();
         return -1;
     }
 
     Gameboy gameboy;
 
-    gameboy.Init(std::make_unique<StdRom>(argv[1]));
+    if (!gameboy.Init(std::make_unique<MappedRom>(romPath)))
+    {
+        printf("Error: Could not load ROM %s.\n", romPath);
+        return -1;
+    }
+
+    // a movie replays from its own state and must not touch the save
+    if (playPath == nullptr)
+    {
+        gameboy.OpenSaveFile(RomSibling(romPath, ".sav").c_str());
+    }
+
+    if (tracePath != nullptr && !gameboy.StartTrace(tracePath, TRACE_CAPACITY))
+    {
+        printf("Error: Could not create trace %s.\n", tracePath);
+        return -1;
+    }
+
+    if (profilePath != nullptr)
+    {
+        gameboy.StartProfile();
+    }
+
+    std::shared_ptr<Movie> movie;
+    if (playPath != nullptr)
+    {
+        movie = std::make_shared<Movie>();
+        if (!movie->Load(playPath) || !gameboy.PlayMovie(movie))
+        {
+            printf("Error: Could not play movie %s.\n", playPath);
+            return -1;
+        }
+
+        if (headless)
+        {
+            int result = PlayHeadless(gameboy, movie);
+            if (profilePath != nullptr)
+            {
+                SaveProfile(gameboy, romPath, profilePath);
+            }
+            return result;
+        }
+    }
+    else if (recordPath != nullptr)
+    {
+        movie = std::make_shared<Movie>();
+        gameboy.RecordMovie(movie);
+    }
+
+    if (rewindEnabled && movie)
+    {
+        // rewinding would make the recorded input non-monotonic
+        printf("Warning: --rewind is ignored while recording or playing a movie.\n");
+        rewindEnabled = false;
+    }
 
     SdlGfx gfx;
-    SdlInput input(gameboy);
-    u8 gbScreen[160 * 144] = { 0 };
+    SdlInput input;
+    SdlAudio audio;
+
+    gameboy.SetAudioOutput(audio.GetRing());
+
+    // the emulation thread owns gameboy until it is stopped
+    EmuThread emu(gameboy, SdlGfx::PALETTE, runAheadFrames, rewindEnabled);
+    emu.SetDisplayRate(gfx.HasVsync() ? gfx.RefreshRate() : 0.0);
+    emu.Start();
 
-    for (;;)
+    while (!input.IsQuitting() && !emu.IsFinished())
     {
-        gameboy.DoFrame(gbScreen);
-        gfx.Blit(gbScreen);
         input.CheckInput();
+        emu.SetButtons(input.GetButtons());
+        emu.SetRewinding(input.IsRewinding());
+        emu.SetTurbo(turbo || input.IsTurbo());
+
+        // with vsync Blit waits for the next refresh, otherwise wait for a new frame
+        if (emu.AcquireFrame() || gfx.HasVsync())
+        {
+            gfx.Blit(emu.GetFrame().Pixels);
+            emu.FramePresented();
+        }
+        else
+        {
+            SDL_Delay(1);
+        }
     }
+
+    emu.Stop();
+    gameboy.SetAudioOutput(nullptr);
+
+#ifdef PERF_COUNTERS
+    gameboy.GetPerfCounters().Report(stdout, PerfCounters());
+#endif
+
+    if (profilePath != nullptr)
+    {
+        SaveProfile(gameboy, romPath, profilePath);
+    }
+
+    if (recordPath != nullptr)
+    {
+        gameboy.StopMovie();
+        if (!movie->Save(recordPath))
+        {
+            printf("Error: Could not save movie %s.\n", recordPath);
+            return -1;
+        }
+    }
+
+    return 0;
 }
\ No newline at end of file
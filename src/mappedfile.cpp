@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : _data(nullptr)
+    , _size(0)
+    , _writable(false)
+    , _file(nullptr)
+    , _mapping(nullptr)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+    return Map(path, 0, false);
+}
+
+bool MappedFile::OpenWritable(const char* path, size_t size)
+{
+    return Map(path, size, true);
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Map(const char* path, size_t size, bool writable)
+{
+    Close();
+
+    HANDLE file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+        writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize))
+    {
+        // mapping past the end of a writable file extends it
+        fileSize.QuadPart = std::max(fileSize.QuadPart, (LONGLONG)size);
+        if (fileSize.QuadPart > 0)
+        {
+            mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, fileSize.HighPart, fileSize.LowPart, nullptr);
+        }
+    }
+
+    if (mapping != nullptr)
+    {
+        _data = (u8*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if (_data == nullptr)
+        {
+            CloseHandle(mapping);
+            mapping = nullptr;
+        }
+    }
+
+    // a read only mapping keeps the file open itself, but flushing needs the handle
+    if (mapping == nullptr || !writable)
+    {
+        CloseHandle(file);
+        file = nullptr;
+    }
+
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+
+    _size = (size_t)fileSize.QuadPart;
+    _writable = writable;
+    _file = file;
+    _mapping = mapping;
+    return true;
+}
+
+bool MappedFile::Flush()
+{
+    if (!_writable)
+    {
+        return false;
+    }
+
+    return FlushViewOfFile(_data, 0) && FlushFileBuffers((HANDLE)_file);
+}
+
+void MappedFile::Close()
+{
+    if (_data != nullptr)
+    {
+        UnmapViewOfFile(_data);
+        CloseHandle((HANDLE)_mapping);
+    }
+
+    if (_file != nullptr)
+    {
+        CloseHandle((HANDLE)_file);
+    }
+
+    _data = nullptr;
+    _size = 0;
+    _writable = false;
+    _file = nullptr;
+    _mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::Map(const char* path, size_t size, bool writable)
+{
+    Close();
+
+    int fd = writable ? open(path, O_RDWR | O_CREAT, 0644) : open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0)
+    {
+        size = std::max((size_t)st.st_size, size);
+        if (size > 0 && (size == (size_t)st.st_size || ftruncate(fd, (off_t)size) == 0))
+        {
+            data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        }
+    }
+
+    // the mapping keeps the file open
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    _data = (u8*)data;
+    _size = size;
+    _writable = writable;
+    return true;
+}
+
+bool MappedFile::Flush()
+{
+    if (!_writable)
+    {
+        return false;
+    }
+
+    return msync(_data, _size, MS_SYNC) == 0;
+}
+
+void MappedFile::Close()
+{
+    if (_data != nullptr)
+    {
+        munmap(_data, _size);
+    }
+
+    _data = nullptr;
+    _size = 0;
+    _writable = false;
+}
+
+#endif
\ No newline at end of file
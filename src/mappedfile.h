@@ -0,0 +1,37 @@
+#pragma once
+
+// A view of a whole file mapped into memory. Pages are loaded on demand and
+// shared with any other mapping of the same file, so large files cost nothing
+// until they are touched and are never copied.
+class MappedFile
+{
+public:
+    MappedFile();
+    virtual ~MappedFile();
+
+    bool Open(const char* path);
+
+    // Maps the file for writing, creating it or extending it to at least size
+    // bytes first. Writes land in the OS's file cache, so they survive the
+    // process exiting at any point; Flush waits for them to reach the disk.
+    bool OpenWritable(const char* path, size_t size);
+    bool Flush();
+
+    void Close();
+
+    const u8* Data() const { return _data; }
+    u8* WritableData() const { return _writable ? _data : nullptr; }
+    size_t Size() const { return _size; }
+
+private:
+    bool Map(const char* path, size_t size, bool writable);
+
+private:
+    u8* _data;
+    size_t _size;
+    bool _writable;
+
+    // Platform handles that keep the mapping alive, if it needs them
+    void* _file;
+    void* _mapping;
+};
\ No newline at end of file
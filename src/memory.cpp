@@ -5,11 +5,15 @@
 #include "video.h"
 #include "timer.h"
 #include "input.h"
+#include "apu.h"
+#include "state.h"
 
 MemoryMap::MemoryMap(const Gameboy& gameboy)
     : _gameboy(gameboy)
     , _cart(nullptr)
     , _video(nullptr)
+    , _io_SB(0)
+    , _io_SC(0)
 {
 }
 
@@ -23,8 +27,9 @@ void MemoryMap::Init()
     _video = _gameboy._video;
     _timer = _gameboy._timer;
     _input = _gameboy._input;
+    _apu = _gameboy._apu;
 
-    _wram.resize(0x2000, 0);
+    _wram.Resize(0x2000, 0);
     _hram.resize(0x80, 0);
 }
 
@@ -34,6 +39,15 @@ void MemoryMap::UnInit()
     _video = nullptr;
     _timer = nullptr;
     _input = nullptr;
+    _apu = nullptr;
+}
+
+void MemoryMap::Serialize(StateStream& state)
+{
+    state.Memory(_wram);
+    state.Vector(_hram);
+    state.Value(_io_SB);
+    state.Value(_io_SC);
 }
 
 u8 MemoryMap::Load(u16 addr)
@@ -41,28 +55,33 @@ u8 MemoryMap::Load(u16 addr)
     if (addr < 0x8000)
     {
         // Cartridge ROM
+        PERF_COUNT(LOAD_ROM);
         return _cart->LoadRom(addr);
     }
     else if (addr < 0xA000)
     {
         // VRAM
+        PERF_COUNT(LOAD_VRAM);
         return _video->LoadVRam(addr);
     }
     else if (addr < 0xC000)
     {
         // Cartridge RAM
+        PERF_COUNT(LOAD_CART_RAM);
         return _cart->LoadRam(addr);
     }
     else if (addr < 0xFE00)
     {
         // RAM and Echo
+        PERF_COUNT(LOAD_WRAM);
         // TODO: Half of this section is swappable for CGB
         addr &= 0x1FFF;
-        return _wram[addr];
+        return _wram.Load(addr);
     }
     else if (addr < 0xFEA0)
     {
         // OAM
+        PERF_COUNT(LOAD_OAM);
         _video->LoadOAM(addr);
     }
     else if (addr < 0xFF00)
@@ -73,6 +92,7 @@ u8 MemoryMap::Load(u16 addr)
     else if (addr < 0xFF4C)
     {
         // I/O
+        PERF_COUNT(LOAD_IO);
         switch (addr)
         {
         case 0xFF00:
@@ -114,8 +134,6 @@ u8 MemoryMap::Load(u16 addr)
         case 0xFF24:
         case 0xFF25:
         case 0xFF26:
-            // NR 52, disable sound
-            return 0x00;
         case 0xFF27:
         case 0xFF28:
         case 0xFF29:
@@ -141,9 +159,7 @@ u8 MemoryMap::Load(u16 addr)
         case 0xFF3D:
         case 0xFF3E:
         case 0xFF3F:
-            // Sound Registers
-            __debugbreak();
-            break;
+            return _apu->Read(addr);
         case 0xFF40:
             return _video->ReadLCDC();
         case 0xFF41:
@@ -179,6 +195,7 @@ u8 MemoryMap::Load(u16 addr)
     else if (addr < 0xFFFF)
     {
         // High RAM
+        PERF_COUNT(LOAD_HRAM);
         addr &= 0x7F;
         return _hram[addr];
     }
@@ -190,33 +207,51 @@ u8 MemoryMap::Load(u16 addr)
     return 0;
 }
 
+u8 MemoryMap::Peek(u16 addr)
+{
+    if ((addr >= 0xA000 && addr < 0xC000 && !_cart->GetRom()->HasRam) ||
+        (addr >= 0xFEA0 && addr < 0xFF00) ||
+        (addr >= 0xFF4C && addr < 0xFF80 && addr != 0xFF4D) ||
+        addr == 0xFF01 || addr == 0xFF02 || addr == 0xFFFF)
+    {
+        return 0xFF;
+    }
+
+    return Load(addr);
+}
+
 void MemoryMap::Store(u16 addr, u8 val)
 {
     if (addr < 0x8000)
     {
         // Cartridge ROM
+        PERF_COUNT(STORE_ROM);
         _cart->StoreRom(addr, val);
     }
     else if (addr < 0xA000)
     {
         // VRAM
+        PERF_COUNT(STORE_VRAM);
         _video->StoreVRam(addr, val);
     }
     else if (addr < 0xC000)
     {
         // Cartridge RAM
+        PERF_COUNT(STORE_CART_RAM);
         _cart->StoreRam(addr, val);
     }
     else if (addr < 0xFE00)
     {
         // RAM and Echo
+        PERF_COUNT(STORE_WRAM);
         // TODO: Half of this section is swappable for CGB
         addr &= 0x1FFF;
-        _wram[addr] = val;
+        _wram.Store(addr, val);
     }
     else if (addr < 0xFEA0)
     {
         // OAM
+        PERF_COUNT(STORE_OAM);
         _video->StoreOAM(addr, val);
     }
     else if (addr < 0xFF00)
@@ -226,6 +261,7 @@ void MemoryMap::Store(u16 addr, u8 val)
     else if (addr < 0xFF4C)
     {
         // I/O
+        PERF_COUNT(STORE_IO);
         switch (addr)
         {
         case 0xFF00:
@@ -309,7 +345,7 @@ void MemoryMap::Store(u16 addr, u8 val)
         case 0xFF3D:
         case 0xFF3E:
         case 0xFF3F:
-            // Sound Registers
+            _apu->Write(addr, val);
             break;
         case 0xFF40:
             _video->WriteLCDC(val);
@@ -354,6 +390,7 @@ void MemoryMap::Store(u16 addr, u8 val)
     else if (addr < 0xFFFF)
     {
         // High RAM
+        PERF_COUNT(STORE_HRAM);
         addr &= 0x7F;
         _hram[addr] = val;
     }
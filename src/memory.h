@@ -1,10 +1,14 @@
 #pragma once
 
+#include "pagedmemory.h"
+
 class Gameboy;
 class Cart;
 class Video;
 class Timer;
 class Input;
+class Apu;
+class StateStream;
 
 class MemoryMap
 {
@@ -15,19 +19,31 @@ public:
     void Init();
     void UnInit();
 
+    void Serialize(StateStream& state);
+
     u8 Load(u16 addr);
     void Store(u16 addr, u8 val);
 
+    // For tools: the same as Load, but addresses that would trap read as 0xFF
+    u8 Peek(u16 addr);
+
+    // Zero-copy views. Work RAM is shared copy-on-write so it can only be
+    // viewed a page at a time, and a page moves when it is next unshared.
+    u32 WramPageCount() const { return _wram.PageCount(); }
+    const u8* WramPage(u32 index) const { return _wram.ReadPage(index); }
+    const u8* Hram() const { return _hram.data(); }
+
 private:
     const Gameboy& _gameboy;
     std::shared_ptr<Cart> _cart;
     std::shared_ptr<Video> _video;
     std::shared_ptr<Timer> _timer;
     std::shared_ptr<Input> _input;
+    std::shared_ptr<Apu> _apu;
 
     // Work RAM C000 - DFFF
     // TODO: Half of this ram is swappable for CGB
-    std::vector<u8> _wram;
+    PagedMemory _wram;
 
     // High RAM FF80 - FFFE
     std::vector<u8> _hram;
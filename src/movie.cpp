@@ -0,0 +1,162 @@
+#include "stdafx.h"
+#include "movie.h"
+#include <fstream>
+
+static const u32 MOVIE_MAGIC = 0x564D4247; // 'GBMV'
+static const u16 MOVIE_VERSION = 1;
+
+struct MovieHeader
+{
+    u32 Magic;
+    u16 Version;
+    u16 HeaderSize;
+    u64 RomHash;
+    u64 FinalStateHash;
+    u32 EndFrame;
+    u32 StartStateSize;
+    u32 EventCount;
+    u32 Reserved;
+};
+static_assert(sizeof(MovieHeader) == 40, "Bad MovieHeader Struct");
+
+Movie::Movie()
+    : RomHash(0)
+    , EndFrame(0)
+    , FinalStateHash(0)
+{
+}
+
+Movie::~Movie()
+{
+}
+
+void Movie::Clear()
+{
+    RomHash = 0;
+    EndFrame = 0;
+    FinalStateHash = 0;
+    StartState.clear();
+    _events.clear();
+}
+
+void Movie::AddEvent(u32 frame, u32 cycle, u8 button, bool pressed)
+{
+    Event event;
+    event.Frame = frame;
+    event.Cycle = cycle;
+    event.Button = button;
+    event.Pressed = pressed ? 1 : 0;
+    event.Reserved = 0;
+    _events.push_back(event);
+}
+
+bool Movie::Load(const char* path)
+{
+    std::ifstream ifs(path, std::ifstream::binary | std::ifstream::ate);
+    if (!ifs)
+    {
+        return false;
+    }
+    u64 fileSize = (u64)ifs.tellg();
+    ifs.seekg(0);
+
+    MovieHeader header;
+    ifs.read((char*)&header, sizeof(header));
+    if (!ifs || header.Magic != MOVIE_MAGIC || header.Version != MOVIE_VERSION || header.HeaderSize != sizeof(MovieHeader))
+    {
+        return false;
+    }
+
+    // sizes are checked against the file before allocating anything for them
+    u64 bodySize = (u64)header.StartStateSize + (u64)header.EventCount * sizeof(Event);
+    if (bodySize > fileSize - sizeof(MovieHeader))
+    {
+        return false;
+    }
+
+    RomHash = header.RomHash;
+    FinalStateHash = header.FinalStateHash;
+    EndFrame = header.EndFrame;
+
+    StartState.resize(header.StartStateSize);
+    _events.resize(header.EventCount);
+    if (!StartState.empty())
+    {
+        ifs.read((char*)&StartState[0], StartState.size());
+    }
+    if (!_events.empty())
+    {
+        ifs.read((char*)&_events[0], _events.size() * sizeof(Event));
+    }
+    if (!ifs)
+    {
+        Clear();
+        return false;
+    }
+
+    // playback seeks through the events in order
+    for (size_t i = 0; i < _events.size(); i++)
+    {
+        const Event& event = _events[i];
+        if (event.Button >= 8)
+        {
+            Clear();
+            return false;
+        }
+        if (i > 0)
+        {
+            const Event& prev = _events[i - 1];
+            if (event.Frame < prev.Frame || (event.Frame == prev.Frame && event.Cycle < prev.Cycle))
+            {
+                Clear();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Movie::Save(const char* path) const
+{
+    std::ofstream ofs(path, std::ofstream::binary);
+    if (!ofs)
+    {
+        return false;
+    }
+
+    MovieHeader header;
+    header.Magic = MOVIE_MAGIC;
+    header.Version = MOVIE_VERSION;
+    header.HeaderSize = sizeof(MovieHeader);
+    header.RomHash = RomHash;
+    header.FinalStateHash = FinalStateHash;
+    header.EndFrame = EndFrame;
+    header.StartStateSize = (u32)StartState.size();
+    header.EventCount = (u32)_events.size();
+    header.Reserved = 0;
+
+    ofs.write((const char*)&header, sizeof(header));
+    if (!StartState.empty())
+    {
+        ofs.write((const char*)&StartState[0], StartState.size());
+    }
+    if (!_events.empty())
+    {
+        ofs.write((const char*)&_events[0], _events.size() * sizeof(Event));
+    }
+
+    return (bool)ofs;
+}
+
+// 64-bit FNV-1a
+u64 Movie::Hash(const u8* data, size_t size)
+{
+    u64 hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
\ No newline at end of file
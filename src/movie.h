@@ -0,0 +1,41 @@
+#pragma once
+
+// An input log for deterministic replay. A movie starts from a save state and
+// records every button change keyed by emulated frame and by CPU cycle within
+// that frame, so playback does not depend on host timing. The hash of the final
+// state is stored when recording stops so replays can verify determinism.
+class Movie
+{
+public:
+    struct Event
+    {
+        u32 Frame;
+        u32 Cycle;
+        u8 Button;
+        u8 Pressed;
+        u16 Reserved;
+    };
+    static_assert(sizeof(Event) == 12, "Bad Movie Event Struct");
+
+public:
+    Movie();
+    virtual ~Movie();
+
+    void Clear();
+    void AddEvent(u32 frame, u32 cycle, u8 button, bool pressed);
+    const std::vector<Event>& Events() const { return _events; }
+
+    bool Load(const char* path);
+    bool Save(const char* path) const;
+
+    static u64 Hash(const u8* data, size_t size);
+
+public:
+    u64 RomHash;
+    u32 EndFrame;
+    u64 FinalStateHash;
+    std::vector<u8> StartState;
+
+private:
+    std::vector<Event> _events;
+};
\ No newline at end of file
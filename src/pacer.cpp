@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include "pacer.h"
+#include <thread>
+
+const double FramePacer::FRAME_RATE = 4194304.0 / 70224.0;
+
+// If emulation falls this many frames behind (debugger break, window drag)
+// start again from now rather than running flat out to catch up
+static const u32 MAX_LAG_FRAMES = 5;
+
+FramePacer::FramePacer()
+    : _period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / FRAME_RATE)))
+    , _frames(0)
+    , _oversleep(std::chrono::milliseconds(1))
+{
+    Reset();
+}
+
+FramePacer::~FramePacer()
+{
+}
+
+void FramePacer::Reset()
+{
+    _start = Clock::now();
+    _frames = 0;
+}
+
+void FramePacer::Wait()
+{
+    Clock::time_point now = Clock::now();
+    Clock::time_point due = _start + _period * _frames;
+
+    if (now - due > _period * MAX_LAG_FRAMES)
+    {
+        _start = now - _period * _frames;
+        due = now;
+    }
+
+    SleepUntil(due);
+    _frames++;
+}
+
+// Sleep for as much of the wait as the OS can be trusted with, then yield for the rest
+void FramePacer::SleepUntil(Clock::time_point deadline)
+{
+    for (;;)
+    {
+        Clock::time_point now = Clock::now();
+        if (now >= deadline)
+        {
+            break;
+        }
+
+        Clock::duration remaining = deadline - now;
+        if (remaining > _oversleep + std::chrono::milliseconds(1))
+        {
+            Clock::duration request = remaining - _oversleep;
+            std::this_thread::sleep_for(request);
+
+            Clock::duration actual = Clock::now() - now;
+            Clock::duration error = actual > request ? actual - request : Clock::duration::zero();
+
+            // track the worst case quickly and relax slowly
+            _oversleep = error > _oversleep ? error : (_oversleep * 15 + error) / 16;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+
+// Keeps emulated time in step with the wall clock. The Game Boy runs at
+// 4194304 / 70224 = ~59.73 frames per second. Wait sleeps until the next frame
+// is due, so a slow frame is made up for by the ones after it.
+class FramePacer
+{
+private:
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    static const double FRAME_RATE;
+
+public:
+    FramePacer();
+    virtual ~FramePacer();
+
+    void Reset();
+    void Wait();
+
+private:
+    void SleepUntil(Clock::time_point deadline);
+
+private:
+    Clock::duration _period;
+
+    Clock::time_point _start;
+    u64 _frames;
+
+    // how much longer than requested the OS tends to sleep
+    Clock::duration _oversleep;
+};
\ No newline at end of file
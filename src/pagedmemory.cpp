@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include "pagedmemory.h"
+
+PagedMemory::PagedMemory()
+    : _size(0)
+{
+}
+
+PagedMemory::~PagedMemory()
+{
+    ReleasePages();
+}
+
+void PagedMemory::Resize(u32 size, u8 fill)
+{
+    ReleasePages();
+    _size = size;
+
+    u32 count = (size + PAGE_MASK) >> PAGE_SHIFT;
+    _pages.clear();
+    _writable.clear();
+
+    if (count != 0)
+    {
+        Page* page = new Page;
+        page->Owners.store(count, std::memory_order_relaxed);
+        memset(page->Bytes, fill, PAGE_SIZE);
+
+        _pages.resize(count, page);
+        _writable.resize(count, nullptr);
+    }
+}
+
+void PagedMemory::ShareFrom(PagedMemory& other)
+{
+    // a new owner only needs the count to stay above one, as in shared_ptr
+    for (Page* page : other._pages)
+    {
+        page->Owners.fetch_add(1, std::memory_order_relaxed);
+    }
+    ReleasePages();
+
+    _size = other._size;
+    _pages = other._pages;
+
+    _writable.assign(_pages.size(), nullptr);
+    other._writable.assign(other._pages.size(), nullptr);
+}
+
+u8* PagedMemory::Unshare(u32 index)
+{
+    Page* page = _pages[index];
+    if (page->Owners.load(std::memory_order_acquire) > 1)
+    {
+        Page* copy = new Page;
+        copy->Owners.store(1, std::memory_order_relaxed);
+        memcpy(copy->Bytes, page->Bytes, PAGE_SIZE);
+
+        if (page->Owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete page;
+        }
+        _pages[index] = page = copy;
+    }
+
+    _writable[index] = page->Bytes;
+    return page->Bytes;
+}
+
+void PagedMemory::ReleasePages()
+{
+    for (Page* page : _pages)
+    {
+        if (page->Owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete page;
+        }
+    }
+}
\ No newline at end of file
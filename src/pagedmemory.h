@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+
+// Byte-addressable memory split into fixed-size pages that can be shared
+// copy-on-write between Gameboy instances. A page is only duplicated the first
+// time an instance writes to it while another instance still references it.
+//
+// Instances sharing pages may run on different threads, so each page counts its
+// owners itself: letting go of a page releases it, and finding yourself its only
+// owner acquires it, so every read another owner made happens before the writes.
+class PagedMemory
+{
+public:
+    static const u32 PAGE_SHIFT = 10;
+    static const u32 PAGE_SIZE = 1 << PAGE_SHIFT;
+    static const u32 PAGE_MASK = PAGE_SIZE - 1;
+
+private:
+    struct Page
+    {
+        // references from the _pages of every instance
+        std::atomic<u32> Owners;
+        u8 Bytes[PAGE_SIZE];
+    };
+
+public:
+    PagedMemory();
+    PagedMemory(const PagedMemory&) = delete;
+    PagedMemory& operator=(const PagedMemory&) = delete;
+    virtual ~PagedMemory();
+
+    // All pages initially share a single page filled with fill
+    void Resize(u32 size, u8 fill);
+    u32 Size() const { return _size; }
+    u32 PageCount() const { return (u32)_pages.size(); }
+
+    // The last page is short when Size isn't a multiple of PAGE_SIZE. Not
+    // std::min, which would need PAGE_SIZE defined out of the class.
+    u32 PageSize(u32 index) const
+    {
+        u32 left = _size - (index << PAGE_SHIFT);
+        return left < PAGE_SIZE ? left : PAGE_SIZE;
+    }
+
+    u8 Load(u32 addr) const
+    {
+        return _pages[addr >> PAGE_SHIFT]->Bytes[addr & PAGE_MASK];
+    }
+
+    void Store(u32 addr, u8 val)
+    {
+        u8* page = _writable[addr >> PAGE_SHIFT];
+        if (page == nullptr)
+        {
+            page = Unshare(addr >> PAGE_SHIFT);
+        }
+        page[addr & PAGE_MASK] = val;
+    }
+
+    const u8* ReadPage(u32 index) const { return _pages[index]->Bytes; }
+    u8* WritePage(u32 index)
+    {
+        u8* page = _writable[index];
+        return page != nullptr ? page : Unshare(index);
+    }
+
+    // Adopt other's pages. Both instances must copy a page before writing to it.
+    void ShareFrom(PagedMemory& other);
+
+private:
+    u8* Unshare(u32 index);
+    void ReleasePages();
+
+private:
+    u32 _size;
+    std::vector<Page*> _pages;
+
+    // Pages this instance holds exclusively, or nullptr if the page may be shared
+    std::vector<u8*> _writable;
+};
\ No newline at end of file
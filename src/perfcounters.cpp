@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include "perfcounters.h"
+
+struct CounterInfo
+{
+    const char* Name;
+    int PerCall;        // counter to divide by as well as frames, or -1
+};
+
+static const CounterInfo COUNTER_INFO[PerfCounters::NUM_COUNTERS] =
+{
+    { "cpu instructions", -1 },
+    { "cpu decode ticks", PerfCounters::CPU_INSTRUCTIONS },
+
+    { "load rom", -1 },
+    { "load vram", -1 },
+    { "load cart ram", -1 },
+    { "load wram", -1 },
+    { "load oam", -1 },
+    { "load io", -1 },
+    { "load hram", -1 },
+
+    { "store rom", -1 },
+    { "store vram", -1 },
+    { "store cart ram", -1 },
+    { "store wram", -1 },
+    { "store oam", -1 },
+    { "store io", -1 },
+    { "store hram", -1 },
+
+    { "video steps", -1 },
+    { "video idle steps", PerfCounters::VIDEO_STEPS },
+    { "video mode changes", PerfCounters::VIDEO_STEPS },
+    { "video step ticks", PerfCounters::VIDEO_STEPS },
+
+    { "timer steps", -1 },
+    { "timer catch up cycles", PerfCounters::TIMER_STEPS },
+    { "timer step ticks", PerfCounters::TIMER_STEPS },
+
+    { "dma transfers", -1 },
+    { "dma ticks", PerfCounters::DMA_TRANSFERS },
+};
+
+PerfCounters::PerfCounters()
+    : Frames(0)
+{
+    memset(Counts, 0, sizeof(Counts));
+}
+
+void PerfCounters::Report(FILE* file, const PerfCounters& since) const
+{
+    u64 frames = Frames - since.Frames;
+    fprintf(file, "%llu frames\n", (unsigned long long)frames);
+    if (frames == 0)
+    {
+        return;
+    }
+
+    fprintf(file, "%-24s %14s %12s\n", "", "per frame", "per call");
+
+    for (u32 i = 0; i < NUM_COUNTERS; i++)
+    {
+        const CounterInfo& info = COUNTER_INFO[i];
+        u64 count = Counts[i] - since.Counts[i];
+        fprintf(file, "%-24s %14.1f", info.Name, (double)count / frames);
+
+        if (info.PerCall >= 0)
+        {
+            u64 calls = Counts[info.PerCall] - since.Counts[info.PerCall];
+            if (calls != 0)
+            {
+                fprintf(file, " %12.3f", (double)count / calls);
+            }
+        }
+        fprintf(file, "\n");
+    }
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#ifdef PERF_COUNTERS
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Host side counts and timings of the emulator's hot paths, for finding where
+// the time goes. They are only compiled in with PERF_COUNTERS defined, otherwise
+// the PERF_ macros expand to nothing and every count stays zero.
+//
+// Counts accumulate for the life of a Gameboy. Report prints the difference
+// between two snapshots averaged per emulated frame. Ticks are the host's time
+// stamp counter, not guest cycles, and include the cost of reading it.
+struct PerfCounters
+{
+    enum Id
+    {
+        CPU_INSTRUCTIONS,
+        CPU_DECODE_TICKS,
+
+        LOAD_ROM,
+        LOAD_VRAM,
+        LOAD_CART_RAM,
+        LOAD_WRAM,
+        LOAD_OAM,
+        LOAD_IO,
+        LOAD_HRAM,
+
+        STORE_ROM,
+        STORE_VRAM,
+        STORE_CART_RAM,
+        STORE_WRAM,
+        STORE_OAM,
+        STORE_IO,
+        STORE_HRAM,
+
+        VIDEO_STEPS,
+        VIDEO_IDLE_STEPS,       // no cycles since the last step
+        VIDEO_MODE_CHANGES,
+        VIDEO_STEP_TICKS,
+
+        TIMER_STEPS,
+        TIMER_CATCH_UP_CYCLES,
+        TIMER_STEP_TICKS,
+
+        DMA_TRANSFERS,
+        DMA_TICKS,
+
+        NUM_COUNTERS
+    };
+
+    u64 Frames;
+    u64 Counts[NUM_COUNTERS];
+
+    PerfCounters();
+
+    void Report(FILE* file, const PerfCounters& since) const;
+
+    static u64 Ticks()
+    {
+#ifdef PERF_COUNTERS
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+};
+
+// Adds the ticks spent in its scope to a counter
+class PerfTimer
+{
+public:
+    PerfTimer(u64& counter)
+        : _counter(counter)
+        , _start(PerfCounters::Ticks())
+    {
+    }
+
+    ~PerfTimer()
+    {
+        _counter += PerfCounters::Ticks() - _start;
+    }
+
+private:
+    u64& _counter;
+    u64 _start;
+};
+
+// For use in the components, which all keep a reference to their Gameboy
+#ifdef PERF_COUNTERS
+#define PERF_COUNT(id) (_gameboy._perfCounters.Counts[PerfCounters::id]++)
+#define PERF_ADD(id, n) (_gameboy._perfCounters.Counts[PerfCounters::id] += (n))
+#define PERF_TIME(id) PerfTimer perfTimer##id(_gameboy._perfCounters.Counts[PerfCounters::id])
+#else
+#define PERF_COUNT(id)
+#define PERF_ADD(id, n)
+#define PERF_TIME(id)
+#endif
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "profiler.h"
+#include "cart.h"
+#include "symbols.h"
+#include "disassembler.h"
+
+Profiler::Profiler(std::shared_ptr<const Rom> rom)
+    : _rom(rom)
+    , _current(0)
+{
+    Reset();
+}
+
+Profiler::~Profiler()
+{
+}
+
+void Profiler::Reset()
+{
+    _flat.assign(0x10000, 0);
+    _banked.clear();
+    _banked.resize(_rom->BankCount());
+
+    Node root;
+    root.Function = ROOT;
+    root.Parent = 0;
+    root.Cycles = 0;
+    _nodes.clear();
+    _nodes.push_back(root);
+
+    _stack.clear();
+    _current = 0;
+}
+
+u64 Profiler::TotalCycles() const
+{
+    u64 total = 0;
+    for (const Node& node : _nodes)
+    {
+        total += node.Cycles;
+    }
+    return total;
+}
+
+u64* Profiler::BankCounters(u16 bank)
+{
+    std::vector<u64>& counters = _banked[bank];
+    if (counters.empty())
+    {
+        counters.resize(0x4000, 0);
+    }
+    return &counters[0];
+}
+
+void Profiler::Call(u16 target, u16 bank, u16 sp)
+{
+    if (_stack.size() == MAX_DEPTH)
+    {
+        return;
+    }
+
+    u32 function = SymbolTable::Key(bank, target);
+    u32 child = 0;
+    for (u32 i : _nodes[_current].Children)
+    {
+        if (_nodes[i].Function == function)
+        {
+            child = i;
+            break;
+        }
+    }
+
+    if (child == 0)
+    {
+        Node node;
+        node.Function = function;
+        node.Parent = _current;
+        node.Cycles = 0;
+        child = (u32)_nodes.size();
+        _nodes.push_back(node);
+        _nodes[_current].Children.push_back(child);
+    }
+
+    Frame frame;
+    frame.Node = child;
+    frame.Sp = sp;
+    _stack.push_back(frame);
+    _current = child;
+}
+
+// sp is after popping, so every frame whose return address is now below it has returned
+void Profiler::Return(u16 sp)
+{
+    while (!_stack.empty() && _stack.back().Sp < sp)
+    {
+        _stack.pop_back();
+    }
+    _current = _stack.empty() ? 0 : _stack.back().Node;
+}
+
+bool Profiler::SaveCollapsed(const char* path, const SymbolTable& symbols) const
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<std::string> labels(_nodes.size());
+    labels[0] = "(root)";
+    for (u32 i = 1; i < _nodes.size(); i++)
+    {
+        // parents are always created before their children
+        labels[i] = labels[_nodes[i].Parent] + ";" + symbols.Label(_nodes[i].Function);
+    }
+
+    for (u32 i = 0; i < _nodes.size(); i++)
+    {
+        if (_nodes[i].Cycles != 0)
+        {
+            fprintf(file, "%s %llu\n", labels[i].c_str(), (unsigned long long)_nodes[i].Cycles);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+bool Profiler::CodeBytes(u32 key, u8 code[3]) const
+{
+    u16 addr = (u16)key;
+    size_t offset = 0;
+    if (addr < 0x4000)
+    {
+        offset = addr;
+    }
+    else if (addr < 0x8000)
+    {
+        offset = (size_t)(key >> 16) * 0x4000 + (addr & 0x3FFF);
+    }
+    else
+    {
+        // RAM, which isn't kept
+        return false;
+    }
+
+    for (u32 i = 0; i < 3; i++)
+    {
+        code[i] = offset + i < _rom->Size() ? (*_rom)[(int)(offset + i)] : 0;
+    }
+    return true;
+}
+
+bool Profiler::SaveHotSpots(const char* path, const SymbolTable& symbols, u32 count) const
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<std::pair<u64, u32>> spots;
+    for (u32 addr = 0; addr < 0x10000; addr++)
+    {
+        if (_flat[addr] != 0)
+        {
+            spots.push_back(std::make_pair(_flat[addr], addr));
+        }
+    }
+    for (u32 bank = 0; bank < _banked.size(); bank++)
+    {
+        for (u32 i = 0; i < _banked[bank].size(); i++)
+        {
+            if (_banked[bank][i] != 0)
+            {
+                spots.push_back(std::make_pair(_banked[bank][i], SymbolTable::Key((u16)bank, (u16)(0x4000 + i))));
+            }
+        }
+    }
+
+    count = std::min(count, (u32)spots.size());
+    std::partial_sort(spots.begin(), spots.begin() + count, spots.end(),
+        [](const std::pair<u64, u32>& a, const std::pair<u64, u32>& b) {
+        return a.first > b.first;
+    });
+
+    double total = (double)std::max<u64>(TotalCycles(), 1);
+    Disassembler disassembler(nullptr);
+    Disassembler::Instruction instr;
+    for (u32 i = 0; i < count; i++)
+    {
+        u8 code[3];
+        const char* disassembly = "";
+        if (CodeBytes(spots[i].second, code))
+        {
+            disassembler.Disassemble((u16)spots[i].second, code, instr);
+            disassembly = instr.GetDisassemblyString();
+        }
+
+        fprintf(file, "%6.2f%% %12llu  %-32s %s\n",
+            100.0 * spots[i].first / total,
+            (unsigned long long)spots[i].first,
+            symbols.Label(spots[i].second).c_str(),
+            disassembly);
+    }
+
+    return fclose(file) == 0;
+}
\ No newline at end of file
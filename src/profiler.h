@@ -0,0 +1,78 @@
+#pragma once
+
+class Rom;
+class SymbolTable;
+
+// Counts the cycles the CPU spends at each guest PC, with switchable ROM
+// counted per bank, and in each call stack. Stacks are shadowed from CALL,
+// RST and interrupts, and RET unwinds to the stack pointer rather than by one
+// frame, so code that drops return addresses or jumps by pushing an address
+// and returning doesn't leave the shadow lost.
+class Profiler
+{
+private:
+    static const u32 ROOT = UINT32_MAX;
+    static const u32 MAX_DEPTH = 256;
+
+    struct Node
+    {
+        u32 Function;   // SymbolTable key of the entry point, or ROOT
+        u32 Parent;
+        u64 Cycles;     // spent in this function itself, when called from this stack
+        std::vector<u32> Children;
+    };
+
+    struct Frame
+    {
+        u32 Node;
+        u16 Sp;         // where the return address was pushed
+    };
+
+public:
+    Profiler(std::shared_ptr<const Rom> rom);
+    virtual ~Profiler();
+
+    void Reset();
+    u64 TotalCycles() const;
+
+    // Called by Cpu. Steps are charged to the stack they began in.
+    u32 CurrentNode() const { return _current; }
+    void Sample(u16 pc, u16 bank, u32 node, u32 cycles)
+    {
+        if (pc >= 0x4000 && pc < 0x8000)
+        {
+            BankCounters(bank)[pc & 0x3FFF] += cycles;
+        }
+        else
+        {
+            _flat[pc] += cycles;
+        }
+        _nodes[node].Cycles += cycles;
+    }
+    void Call(u16 target, u16 bank, u16 sp);
+    void Return(u16 sp);
+
+    // One "caller;callee;... cycles" line per stack, for flamegraph.pl and
+    // similar tools
+    bool SaveCollapsed(const char* path, const SymbolTable& symbols) const;
+
+    // The count hottest PCs, each with its share of cycles, label and
+    // disassembly
+    bool SaveHotSpots(const char* path, const SymbolTable& symbols, u32 count) const;
+
+private:
+    u64* BankCounters(u16 bank);
+    bool CodeBytes(u32 key, u8 code[3]) const;
+
+private:
+    std::shared_ptr<const Rom> _rom;
+
+    // Every address outside 4000 - 7FFF, then 4000 - 7FFF for each bank that has run
+    std::vector<u64> _flat;
+    std::vector<std::vector<u64>> _banked;
+
+    // The call tree, where node 0 is the root
+    std::vector<Node> _nodes;
+    std::vector<Frame> _stack;
+    u32 _current;
+};
\ No newline at end of file
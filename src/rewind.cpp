@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "rewind.h"
+#include "gameboy.h"
+
+Rewind::Rewind(Gameboy& gameboy, u32 capacity, u32 keyframeInterval)
+    : _gameboy(gameboy)
+    , _keyframeInterval(keyframeInterval)
+    , _entries(capacity)
+    , _head(0)
+    , _count(0)
+    , _sinceKeyframe(0)
+{
+}
+
+Rewind::~Rewind()
+{
+}
+
+void Rewind::Capture()
+{
+    size_t size = _gameboy.SaveStateSize();
+    _current.resize(size);
+    _gameboy.SaveState(&_current[0], size);
+
+    if (_previous.size() != size)
+    {
+        // different cart or state layout, nothing to delta against
+        Clear();
+        _previous.resize(size);
+    }
+
+    if (_count == _entries.size())
+    {
+        _head = (_head + 1) % _entries.size();
+        _count--;
+    }
+
+    bool keyframe = (_count == 0) || (_sinceKeyframe + 1 >= _keyframeInterval);
+    _sinceKeyframe = keyframe ? 0 : _sinceKeyframe + 1;
+
+    Entry& entry = At(_count++);
+    entry.Keyframe = keyframe;
+    Encode(&_current[0], keyframe ? nullptr : &_previous[0], size, entry.Data);
+
+    std::swap(_current, _previous);
+}
+
+bool Rewind::Step(u32 frames)
+{
+    // once the ring wraps, frames before the oldest remaining keyframe can't be rebuilt
+    u32 first = 0;
+    while (first < _count && !At(first).Keyframe)
+    {
+        first++;
+    }
+
+    if (first >= _count)
+    {
+        return false;
+    }
+
+    u32 newest = _count - 1;
+    u32 target = frames > newest - first ? first : newest - frames;
+
+    u32 key = target;
+    while (!At(key).Keyframe)
+    {
+        key--;
+    }
+
+    memset(&_previous[0], 0, _previous.size());
+    for (u32 i = key; i <= target; i++)
+    {
+        Decode(At(i).Data, &_previous[0], _previous.size());
+    }
+
+    _count = target + 1;
+    _sinceKeyframe = target - key;
+
+    return _gameboy.LoadState(&_previous[0], _previous.size());
+}
+
+void Rewind::Clear()
+{
+    _head = 0;
+    _count = 0;
+    _sinceKeyframe = 0;
+}
+
+size_t Rewind::MemoryUsage() const
+{
+    size_t usage = _current.capacity() + _previous.capacity();
+    for (const Entry& entry : _entries)
+    {
+        usage += entry.Data.capacity();
+    }
+    return usage;
+}
+
+static void PutVarint(std::vector<u8>& out, size_t val)
+{
+    while (val >= 0x80)
+    {
+        out.push_back((u8)(val | 0x80));
+        val >>= 7;
+    }
+    out.push_back((u8)val);
+}
+
+static size_t GetVarint(const u8*& p)
+{
+    size_t val = 0;
+    u32 shift = 0;
+    while ((*p & 0x80) != 0)
+    {
+        val |= (size_t)(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    val |= (size_t)(*p++) << shift;
+    return val;
+}
+
+static u64 Load64(const u8* p)
+{
+    u64 val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+// The encoding is a sequence of (unchanged run length, changed run length, changed
+// bytes XOR previous) triples. Keyframes are encoded against an all zero state.
+void Rewind::Encode(const u8* state, const u8* previous, size_t size, std::vector<u8>& out)
+{
+    static const u8 ZEROES[8] = { 0 };
+
+    out.clear();
+
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t start = i;
+        if (previous != nullptr)
+        {
+            while (i + 8 <= size && Load64(state + i) == Load64(previous + i)) i += 8;
+            while (i < size && state[i] == previous[i]) i++;
+        }
+        else
+        {
+            while (i + 8 <= size && Load64(state + i) == Load64(ZEROES)) i += 8;
+            while (i < size && state[i] == 0) i++;
+        }
+        PutVarint(out, i - start);
+
+        if (i == size)
+        {
+            break;
+        }
+
+        // a single unchanged byte costs less inside a literal than as its own run
+        start = i;
+        while (i < size)
+        {
+            u8 diff = previous != nullptr ? state[i] ^ previous[i] : state[i];
+            if (diff == 0)
+            {
+                u8 next = 0;
+                if (i + 1 < size)
+                {
+                    next = previous != nullptr ? state[i + 1] ^ previous[i + 1] : state[i + 1];
+                }
+                if (next == 0)
+                {
+                    break;
+                }
+            }
+            i++;
+        }
+
+        PutVarint(out, i - start);
+        for (size_t j = start; j < i; j++)
+        {
+            out.push_back(previous != nullptr ? state[j] ^ previous[j] : state[j]);
+        }
+    }
+}
+
+void Rewind::Decode(const std::vector<u8>& in, u8* state, size_t size)
+{
+    const u8* p = in.data();
+    const u8* end = p + in.size();
+
+    size_t i = 0;
+    while (p < end && i < size)
+    {
+        i += GetVarint(p);
+        if (p >= end)
+        {
+            break;
+        }
+
+        size_t count = GetVarint(p);
+        for (size_t j = 0; j < count; j++)
+        {
+            state[i++] ^= *p++;
+        }
+    }
+}
\ No newline at end of file
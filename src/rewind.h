@@ -0,0 +1,52 @@
+#pragma once
+
+class Gameboy;
+
+// Ring buffer of per-frame save states. Every frame is stored as the XOR of its
+// state against the previous frame's, run-length encoded, so frames that only
+// touch a few hundred bytes of RAM cost a few hundred bytes of history. Every
+// KeyframeInterval frames a full (run-length encoded) state is stored instead,
+// which bounds how many deltas must be replayed to reach any frame.
+class Rewind
+{
+private:
+    struct Entry
+    {
+        bool Keyframe;
+        std::vector<u8> Data;
+    };
+
+public:
+    Rewind(Gameboy& gameboy, u32 capacity = 60 * 60, u32 keyframeInterval = 60);
+    virtual ~Rewind();
+
+    // Call once per emulated frame
+    void Capture();
+
+    // Restores the state from frames captures ago and discards everything newer.
+    // Returns false if there is no history to rewind to.
+    bool Step(u32 frames);
+
+    void Clear();
+
+    u32 Count() const { return _count; }
+    size_t MemoryUsage() const;
+
+private:
+    Entry& At(u32 i) { return _entries[(_head + i) % _entries.size()]; }
+
+    static void Encode(const u8* state, const u8* previous, size_t size, std::vector<u8>& out);
+    static void Decode(const std::vector<u8>& in, u8* state, size_t size);
+
+private:
+    Gameboy& _gameboy;
+    u32 _keyframeInterval;
+
+    std::vector<Entry> _entries;
+    u32 _head;
+    u32 _count;
+    u32 _sinceKeyframe;
+
+    std::vector<u8> _current;
+    std::vector<u8> _previous;
+};
\ No newline at end of file
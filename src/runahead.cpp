@@ -0,0 +1,47 @@
+#include "stdafx.h"
+#include "runahead.h"
+#include "gameboy.h"
+#include "screenbuffer.h"
+
+RunAhead::RunAhead(Gameboy& gameboy, u32 frames)
+    : _gameboy(gameboy)
+    , _frames(frames)
+{
+}
+
+RunAhead::~RunAhead()
+{
+}
+
+void RunAhead::DoFrame(const ScreenBuffer& screen)
+{
+    // a frame that isn't shown has no lag to hide
+    if (_frames == 0 || screen.Pixels == nullptr)
+    {
+        _gameboy.DoFrame(screen);
+        return;
+    }
+
+    _gameboy.DoFrame(nullptr);
+
+    size_t size = _gameboy.SaveStateSize();
+    if (_state.size() != size)
+    {
+        _state.resize(size);
+    }
+    _gameboy.SaveState(&_state[0], size);
+
+    // only the real frame is heard, and saved
+    _gameboy.MuteAudio(true);
+    _gameboy.SetSpeculative(true);
+
+    for (u32 i = 1; i < _frames; i++)
+    {
+        _gameboy.DoFrame(nullptr);
+    }
+    _gameboy.DoFrame(screen);
+
+    _gameboy.LoadState(&_state[0], size);
+    _gameboy.MuteAudio(false);
+    _gameboy.SetSpeculative(false);
+}
\ No newline at end of file
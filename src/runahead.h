@@ -0,0 +1,22 @@
+#pragma once
+
+class Gameboy;
+struct ScreenBuffer;
+
+// Hides the input lag of games that poll the joypad once per frame. Each host
+// frame runs the real frame without rendering, snapshots it, runs Frames more
+// frames ahead with the same input, shows the last of those and then restores
+// the snapshot.
+class RunAhead
+{
+public:
+    RunAhead(Gameboy& gameboy, u32 frames);
+    virtual ~RunAhead();
+
+    void DoFrame(const ScreenBuffer& screen);
+
+private:
+    Gameboy& _gameboy;
+    u32 _frames;
+    std::vector<u8> _state;
+};
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "stdafx.h"
+#include "savefile.h"
+#include <fstream>
+
+SaveFile::SaveFile()
+    : _hasData(false)
+    , _pending(false)
+    , _quit(false)
+{
+}
+
+SaveFile::~SaveFile()
+{
+    Close();
+}
+
+bool SaveFile::Open(const char* path, u32 size)
+{
+    Close();
+
+    // anything shorter than the cart's RAM isn't a save we can use, but keep
+    // anything past it, such as clock data from other emulators
+    std::ifstream ifs(path, std::ifstream::binary | std::ifstream::ate);
+    _hasData = ifs && ifs.tellg() >= (std::streamoff)size;
+    ifs.close();
+
+    if (!_file.OpenWritable(path, size))
+    {
+        _hasData = false;
+        return false;
+    }
+
+    _pending = false;
+    _quit = false;
+    _thread = std::thread(&SaveFile::Run, this);
+    return true;
+}
+
+void SaveFile::Close()
+{
+    if (_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _quit = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+    }
+
+    _file.Close();
+    _hasData = false;
+}
+
+bool SaveFile::Write(u32 offset, const u8* data, u32 size)
+{
+    u8* dest = _file.WritableData() + offset;
+    if (memcmp(dest, data, size) == 0)
+    {
+        return false;
+    }
+
+    memcpy(dest, data, size);
+    return true;
+}
+
+void SaveFile::Flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending = true;
+    }
+    _wake.notify_one();
+}
+
+void SaveFile::Run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        _wake.wait(lock, [this] { return _pending || _quit; });
+
+        // a last flush on the way out if one was asked for
+        if (_pending)
+        {
+            _pending = false;
+            lock.unlock();
+            _file.Flush();
+            lock.lock();
+        }
+        else if (_quit)
+        {
+            break;
+        }
+    }
+}
\ No newline at end of file
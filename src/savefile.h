@@ -0,0 +1,42 @@
+#pragma once
+
+#include "mappedfile.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Battery backed cart RAM kept in a memory-mapped save file. The emulation
+// thread only copies changed bytes into the mapping, and a background thread
+// flushes the mapping to disk, so saving never waits on I/O. Copied data sits
+// in the OS's file cache and survives the process crashing before a flush.
+class SaveFile
+{
+public:
+    SaveFile();
+    virtual ~SaveFile();
+
+    bool Open(const char* path, u32 size);
+    void Close();
+
+    // The file's contents, if it already held a full save when it was opened
+    const u8* SavedData() const { return _hasData ? _file.Data() : nullptr; }
+
+    // Returns true if anything changed. Flush must be called to persist it.
+    bool Write(u32 offset, const u8* data, u32 size);
+
+    // Wakes the flush thread without waiting for it
+    void Flush();
+
+private:
+    void Run();
+
+private:
+    MappedFile _file;
+    bool _hasData;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _pending;
+    bool _quit;
+};
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "screenbuffer.h"
+
+static const u8 GRAY[4] = { 255, 170, 85, 0 };
+
+ScreenBuffer::ScreenBuffer()
+    : Pixels(nullptr)
+    , Pitch(0)
+    , PixelFormat(Format::Shade8)
+    , Scale(1)
+    , Palette()
+{
+    memset(_sums, 0, sizeof(_sums));
+}
+
+ScreenBuffer::ScreenBuffer(u8* shades)
+    : Pixels(shades)
+    , Pitch(WIDTH)
+    , PixelFormat(Format::Shade8)
+    , Scale(1)
+    , Palette()
+{
+    memset(_sums, 0, sizeof(_sums));
+}
+
+ScreenBuffer::ScreenBuffer(u8* pixels, Format format, u32 scale)
+    : Pixels(pixels)
+    , Pitch(WIDTH / scale)
+    , PixelFormat(format)
+    , Scale(scale)
+    , Palette()
+{
+    if (format == Format::Rgba32 || (scale != 1 && scale != 2 && scale != 4))
+    {
+        __debugbreak();
+    }
+    memset(_sums, 0, sizeof(_sums));
+}
+
+ScreenBuffer::ScreenBuffer(u32* pixels, u32 pitch, const u32 palette[4])
+    : Pixels((u8*)pixels)
+    , Pitch(pitch)
+    , PixelFormat(Format::Rgba32)
+    , Scale(1)
+{
+    memcpy(Palette, palette, sizeof(Palette));
+    memset(_sums, 0, sizeof(_sums));
+}
+
+void ScreenBuffer::Retarget(const ScreenBuffer& other)
+{
+    if (PixelFormat != other.PixelFormat || Scale != other.Scale)
+    {
+        *this = other;
+        return;
+    }
+
+    Pixels = other.Pixels;
+    Pitch = other.Pitch;
+    memcpy(Palette, other.Palette, sizeof(Palette));
+}
+
+void ScreenBuffer::BlankRow(u32 y) const
+{
+    u8* row = Pixels + y * Pitch;
+    switch (PixelFormat)
+    {
+    case Format::Shade8:
+        memset(row, 0, Width());
+        break;
+    case Format::Gray8:
+        memset(row, GRAY[0], Width());
+        break;
+    case Format::Rgba32:
+        std::fill((u32*)row, (u32*)row + WIDTH, Palette[0]);
+        break;
+    }
+}
+
+void ScreenBuffer::WriteLine(u32 y, const u8 shades[WIDTH]) const
+{
+    if (Scale > 1)
+    {
+        // the first line of a block starts the sums afresh, so lines skipped
+        // in an earlier block can't leak into this one
+        const u8* values = PixelFormat == Format::Gray8 ? GRAY : nullptr;
+        bool first = y % Scale == 0;
+        for (u32 x = 0; x < WIDTH / Scale; x++)
+        {
+            u32 sum = first ? 0 : _sums[x];
+            for (u32 i = 0; i < Scale; i++)
+            {
+                u8 shade = shades[x * Scale + i];
+                sum += values != nullptr ? values[shade] : shade;
+            }
+            _sums[x] = (u16)sum;
+        }
+
+        if (y % Scale == Scale - 1)
+        {
+            u32 count = Scale * Scale;
+            u8* row = Pixels + (y / Scale) * Pitch;
+            for (u32 x = 0; x < WIDTH / Scale; x++)
+            {
+                row[x] = (u8)((_sums[x] + count / 2) / count);
+            }
+        }
+        return;
+    }
+
+    u8* row = Pixels + y * Pitch;
+    switch (PixelFormat)
+    {
+    case Format::Shade8:
+        memcpy(row, shades, WIDTH);
+        break;
+    case Format::Gray8:
+        for (u32 x = 0; x < WIDTH; x++)
+        {
+            row[x] = GRAY[shades[x]];
+        }
+        break;
+    case Format::Rgba32:
+        {
+            u32* pixels = (u32*)row;
+            for (u32 x = 0; x < WIDTH; x++)
+            {
+                pixels[x] = Palette[shades[x]];
+            }
+        }
+        break;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+// Describes the memory Video renders into. Shade8 writes the raw 2-bit shade of
+// each pixel, Gray8 its luminance from 255 (lightest) to 0, and Rgba32 looks
+// each shade up in Palette and writes the host pixel directly, e.g. into a
+// locked streaming texture. Rows are Pitch bytes apart. A buffer with no
+// Pixels skips rendering entirely.
+//
+// The 8-bit formats can be downsampled by a Scale of 2 or 4 as lines are
+// written, each output pixel being the rounded mean of a Scale x Scale block.
+struct ScreenBuffer
+{
+public:
+    static const u32 WIDTH = 160;
+    static const u32 HEIGHT = 144;
+
+    enum class Format
+    {
+        Shade8,
+        Gray8,
+        Rgba32,
+    };
+
+public:
+    ScreenBuffer();
+    explicit ScreenBuffer(u8* shades);
+    ScreenBuffer(u8* pixels, Format format, u32 scale);
+    ScreenBuffer(u32* pixels, u32 pitch, const u32 palette[4]);
+
+    u32 Width() const { return WIDTH / Scale; }
+    u32 Height() const { return HEIGHT / Scale; }
+
+    void WriteLine(u32 y, const u8 shades[WIDTH]) const;
+
+    // Fills output row y with shade 0 without going through the sums
+    void BlankRow(u32 y) const;
+
+    // Renders into other's pixels from now on, keeping the sums of a block
+    // row already begun
+    void Retarget(const ScreenBuffer& other);
+
+public:
+    u8* Pixels;
+    u32 Pitch;
+    Format PixelFormat;
+    u32 Scale;
+    u32 Palette[4];
+
+private:
+    // Column sums for the block row being downsampled
+    mutable u16 _sums[WIDTH / 2];
+};
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "stdafx.h"
+#include "state.h"
+#include "pagedmemory.h"
+
+void StateStream::Memory(PagedMemory& mem)
+{
+    if (_shared != nullptr)
+    {
+        switch (_mode)
+        {
+        case Mode::Save:
+            _shared->push_back(&mem);
+            break;
+        case Mode::Load:
+            mem.ShareFrom(*(*_shared)[_sharedIndex++]);
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
+    u32 pageCount = mem.PageCount();
+    for (u32 i = 0; i < pageCount; i++)
+    {
+        u32 size = mem.PageSize(i);
+        if (_mode == Mode::Load)
+        {
+            // only take a private copy of pages that actually differ
+            if (_pos + size <= _size && memcmp(mem.ReadPage(i), _buffer + _pos, size) == 0)
+            {
+                _pos += size;
+                continue;
+            }
+            Bytes(mem.WritePage(i), size);
+        }
+        else
+        {
+            Bytes(const_cast<u8*>(mem.ReadPage(i)), size);
+        }
+    }
+}
\ No newline at end of file
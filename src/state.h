@@ -0,0 +1,108 @@
+#pragma once
+
+// Save states are a flat binary blob: a StateHeader followed by each component's
+// state in a fixed order. Every component describes its state once, in Serialize,
+// and the same code path is used for measuring, saving and loading.
+//
+// Bump STATE_VERSION whenever any component changes what it serializes.
+
+class PagedMemory;
+
+static const u32 STATE_MAGIC = 0x53534247; // 'GBSS'
+static const u16 STATE_VERSION = 8;
+
+struct StateHeader
+{
+    u32 Magic;
+    u16 Version;
+    u16 HeaderSize;
+    u32 Size;
+    u32 Reserved;
+};
+static_assert(sizeof(StateHeader) == 16, "Bad StateHeader Struct");
+
+class StateStream
+{
+public:
+    enum class Mode
+    {
+        Measure,
+        Save,
+        Load
+    };
+
+public:
+    StateStream(Mode mode, u8* buffer, size_t size)
+        : _mode(mode)
+        , _buffer(buffer)
+        , _size(size)
+        , _pos(0)
+        , _overflow(false)
+        , _shared(nullptr)
+        , _sharedIndex(0)
+    {
+    }
+
+    // Used for forking: paged memory is not copied through the buffer. Saving
+    // records each region in shared, and loading adopts the recorded pages.
+    StateStream(Mode mode, u8* buffer, size_t size, std::vector<PagedMemory*>* shared)
+        : StateStream(mode, buffer, size)
+    {
+        _shared = shared;
+    }
+
+    Mode GetMode() const { return _mode; }
+    bool IsLoading() const { return _mode == Mode::Load; }
+    size_t Position() const { return _pos; }
+    bool Ok() const { return !_overflow; }
+
+    void Bytes(void* data, size_t size)
+    {
+        if (_mode != Mode::Measure)
+        {
+            if (_overflow || size > _size - _pos)
+            {
+                _overflow = true;
+                return;
+            }
+
+            if (_mode == Mode::Save)
+            {
+                memcpy(_buffer + _pos, data, size);
+            }
+            else
+            {
+                memcpy(data, _buffer + _pos, size);
+            }
+        }
+
+        _pos += size;
+    }
+
+    template <class T>
+    void Value(T& val)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "StateStream::Value requires a trivially copyable type");
+        Bytes(&val, sizeof(T));
+    }
+
+    void Vector(std::vector<u8>& vec)
+    {
+        if (!vec.empty())
+        {
+            Bytes(&vec[0], vec.size());
+        }
+    }
+
+    void Memory(PagedMemory& mem);
+
+private:
+    Mode _mode;
+    u8* _buffer;
+    size_t _size;
+    size_t _pos;
+    bool _overflow;
+
+    std::vector<PagedMemory*>* _shared;
+    size_t _sharedIndex;
+};
\ No newline at end of file
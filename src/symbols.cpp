@@ -0,0 +1,65 @@
+#include "stdafx.h"
+#include "symbols.h"
+#include <fstream>
+
+SymbolTable::SymbolTable()
+{
+}
+
+SymbolTable::~SymbolTable()
+{
+}
+
+bool SymbolTable::Load(const char* path)
+{
+    std::ifstream ifs(path);
+    if (!ifs)
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        size_t comment = line.find(';');
+        if (comment != std::string::npos)
+        {
+            line.resize(comment);
+        }
+
+        unsigned int bank = 0;
+        unsigned int addr = 0;
+        char name[256];
+        if (sscanf(line.c_str(), "%x:%x %255s", &bank, &addr, name) == 3 && addr <= 0xFFFF)
+        {
+            _symbols[Key((u16)bank, (u16)addr)] = name;
+        }
+    }
+
+    return true;
+}
+
+std::string SymbolTable::Label(u32 key) const
+{
+    std::stringstream ss;
+    ss << std::uppercase << std::hex << std::setfill('0');
+
+    // labels in another bank or 16K region aren't near, however close the key
+    std::map<u32, std::string>::const_iterator it = _symbols.upper_bound(key);
+    if (it != _symbols.begin())
+    {
+        --it;
+        if ((it->first >> 14) == (key >> 14))
+        {
+            ss << it->second;
+            if (it->first != key)
+            {
+                ss << "+$" << (key - it->first);
+            }
+            return ss.str();
+        }
+    }
+
+    ss << std::setw(2) << (key >> 16) << ':' << std::setw(4) << (key & 0xFFFF);
+    return ss.str();
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <map>
+
+// Labels from a .sym file, as written by RGBDS and read by BGB and no$gmb:
+// one "BB:AAAA Name" per line, with ';' starting a comment. Addresses in
+// 4000 - 7FFF belong to bank BB, everything else to bank 0.
+class SymbolTable
+{
+public:
+    SymbolTable();
+    virtual ~SymbolTable();
+
+    bool Load(const char* path);
+    bool Empty() const { return _symbols.empty(); }
+
+    // Addresses are keyed by bank so switchable ROM can be told apart
+    static u32 Key(u16 bank, u16 addr)
+    {
+        return addr >= 0x4000 && addr < 0x8000 ? ((u32)bank << 16) | addr : addr;
+    }
+
+    // The nearest label at or before key in the same bank, plus an offset,
+    // or BB:AAAA if there is none
+    std::string Label(u32 key) const;
+
+private:
+    std::map<u32, std::string> _symbols;
+};
\ No newline at end of file
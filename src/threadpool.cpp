@@ -0,0 +1,88 @@
+#include "stdafx.h"
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(u32 threads)
+    : _quit(false)
+    , _generation(0)
+    , _busy(0)
+    , _job(nullptr)
+    , _count(0)
+    , _next(0)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (u32 i = 1; i < threads; i++)
+    {
+        _workers.emplace_back(&ThreadPool::Worker, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _start.notify_all();
+
+    for (std::thread& worker : _workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::Run(u32 count, const std::function<void(u32)>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &job;
+        _count = count;
+        _next = 0;
+        _busy = (u32)_workers.size();
+        _generation++;
+    }
+    _start.notify_all();
+
+    Work();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _busy == 0; });
+    _job = nullptr;
+}
+
+void ThreadPool::Worker()
+{
+    u64 generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start.wait(lock, [&] { return _quit || _generation != generation; });
+            if (_quit)
+            {
+                return;
+            }
+            generation = _generation;
+        }
+
+        Work();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _busy--;
+        }
+        _done.notify_one();
+    }
+}
+
+// Indices are handed out one at a time so uneven jobs still balance
+void ThreadPool::Work()
+{
+    for (u32 i = _next++; i < _count; i = _next++)
+    {
+        (*_job)(i);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// A fixed set of worker threads for running the same job over many indices.
+// The calling thread takes part too, so a pool of one thread is just a loop.
+class ThreadPool
+{
+public:
+    // threads includes the caller, 0 uses one per hardware thread
+    ThreadPool(u32 threads);
+    virtual ~ThreadPool();
+
+    u32 ThreadCount() const { return (u32)_workers.size() + 1; }
+
+    // Calls job for every index in [0, count) and returns once all are done.
+    // Only one Run may be in progress at a time.
+    void Run(u32 count, const std::function<void(u32)>& job);
+
+private:
+    void Worker();
+    void Work();
+
+private:
+    std::vector<std::thread> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _start;
+    std::condition_variable _done;
+    bool _quit;
+
+    // Bumped for each Run so workers know there is a new job
+    u64 _generation;
+    u32 _busy;
+
+    const std::function<void(u32)>* _job;
+    u32 _count;
+    std::atomic<u32> _next;
+};
\ No newline at end of file
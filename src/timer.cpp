@@ -2,6 +2,7 @@
 #include "timer.h"
 #include "gameboy.h"
 #include "cpu.h"
+#include "state.h"
 
 Timer::Timer(const Gameboy& gameboy)
     : _gameboy(gameboy)
@@ -31,11 +32,31 @@ void Timer::UnInit()
     _cpu = nullptr;
 }
 
+void Timer::Serialize(StateStream& state)
+{
+    state.Value(_div);
+    state.Value(_tima);
+    state.Value(_tma);
+    state.Value(_tac);
+    state.Value(_cycles);
+    state.Value(_intPending);
+
+    if (state.IsLoading())
+    {
+        DecodeTAC();
+    }
+}
+
 void Timer::Step()
 {
+    PERF_TIME(TIMER_STEP_TICKS);
+
     int cycles = _cpu->GetCycles() - _cycles;
     _cycles = _cpu->GetCycles();
 
+    PERF_COUNT(TIMER_STEPS);
+    PERF_ADD(TIMER_CATCH_UP_CYCLES, cycles);
+
     for (u32 i = 0; i < cycles; i++)
     {
         if (_intPending)
@@ -113,6 +134,11 @@ void Timer::WriteTAC(u8 val)
 {
     Step();
     _tac = val;
+    DecodeTAC();
+}
+
+void Timer::DecodeTAC()
+{
     _timerEnabled = (_tac & (1 << 2)) != 0l;
     switch (_tac & 0x3)
     {
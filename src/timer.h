@@ -3,6 +3,7 @@
 #include "cpu.h"
 
 class Gameboy;
+class StateStream;
 
 class Timer
 {
@@ -13,6 +14,8 @@ public:
     void Init();
     void UnInit();
 
+    void Serialize(StateStream& state);
+
     void Step();
 
     u8 ReadDIV();
@@ -26,6 +29,9 @@ public:
 
     void BeforeFrame() { _cycles -= _cpu->GetCycles(); }
 
+private:
+    void DecodeTAC();
+
 private:
     const Gameboy& _gameboy;
     std::shared_ptr<Cpu> _cpu;
@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include "trace.h"
+
+static const u32 TRACE_MAGIC = 0x52544247; // 'GBTR'
+static const u16 TRACE_VERSION = 1;
+
+TraceBuffer::TraceBuffer()
+    : _header(nullptr)
+    , _records(nullptr)
+    , _next(0)
+{
+}
+
+TraceBuffer::~TraceBuffer()
+{
+    Close();
+}
+
+static void InitHeader(TraceHeader& header, u32 capacity)
+{
+    header.Magic = TRACE_MAGIC;
+    header.Version = TRACE_VERSION;
+    header.RecordSize = sizeof(TraceRecord);
+    header.Capacity = capacity;
+    header.Reserved = 0;
+    header.Count = 0;
+}
+
+void TraceBuffer::Create(u32 capacity)
+{
+    Close();
+
+    _memory.resize(sizeof(TraceHeader) + (size_t)capacity * sizeof(TraceRecord));
+    InitHeader(*(TraceHeader*)&_memory[0], capacity);
+    Attach(&_memory[0]);
+}
+
+bool TraceBuffer::Create(const char* path, u32 capacity)
+{
+    Close();
+
+    if (!_file.OpenWritable(path, sizeof(TraceHeader) + (size_t)capacity * sizeof(TraceRecord)))
+    {
+        return false;
+    }
+
+    InitHeader(*(TraceHeader*)_file.WritableData(), capacity);
+    Attach(_file.WritableData());
+    return true;
+}
+
+bool TraceBuffer::Open(const char* path)
+{
+    Close();
+
+    if (!_file.Open(path) || _file.Size() < sizeof(TraceHeader))
+    {
+        _file.Close();
+        return false;
+    }
+
+    const TraceHeader* header = (const TraceHeader*)_file.Data();
+    if (header->Magic != TRACE_MAGIC ||
+        header->Version != TRACE_VERSION ||
+        header->RecordSize != sizeof(TraceRecord) ||
+        header->Capacity == 0 ||
+        _file.Size() < sizeof(TraceHeader) + (size_t)header->Capacity * sizeof(TraceRecord))
+    {
+        _file.Close();
+        return false;
+    }
+
+    // read only, Write must not be called
+    Attach(const_cast<u8*>(_file.Data()));
+    return true;
+}
+
+void TraceBuffer::Attach(u8* data)
+{
+    _header = (TraceHeader*)data;
+    _records = (TraceRecord*)(data + sizeof(TraceHeader));
+    _next = (u32)(_header->Count % _header->Capacity);
+}
+
+void TraceBuffer::Close()
+{
+    _file.Close();
+    _memory.clear();
+    _memory.shrink_to_fit();
+    _header = nullptr;
+    _records = nullptr;
+    _next = 0;
+}
+
+void TraceBuffer::Flush()
+{
+    _file.Flush();
+}
+
+u32 TraceBuffer::Size() const
+{
+    return (u32)std::min<u64>(_header->Count, _header->Capacity);
+}
+
+const TraceRecord& TraceBuffer::Get(u32 i) const
+{
+    u32 oldest = _header->Count > _header->Capacity ? _next : 0;
+    return _records[(u32)(((u64)oldest + i) % _header->Capacity)];
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "mappedfile.h"
+
+// A binary instruction trace. The CPU copies a fixed-size record into a ring
+// holding the most recent instructions, which is cheap enough to leave on.
+// The ring can live in a memory-mapped file, so it outlives the process if
+// it crashes. Nothing is disassembled while tracing; gbtool does that offline.
+struct TraceRecord
+{
+    u64 Cycle;      // CPU cycles since power on, before the instruction
+    u16 PC;
+    u16 Bank;       // ROM bank mapped at 4000 - 7FFF
+    u16 AF;
+    u16 BC;
+    u16 DE;
+    u16 HL;
+    u16 SP;
+    u8 Code[3];     // the opcode and the two bytes after it
+    u8 Reserved[7];
+};
+static_assert(sizeof(TraceRecord) == 32, "Bad TraceRecord Struct");
+
+struct TraceHeader
+{
+    u32 Magic;
+    u16 Version;
+    u16 RecordSize;
+    u32 Capacity;
+    u32 Reserved;
+    u64 Count;      // records ever written, so the newest is at (Count - 1) % Capacity
+};
+static_assert(sizeof(TraceHeader) == 24, "Bad TraceHeader Struct");
+
+class TraceBuffer
+{
+public:
+    TraceBuffer();
+    virtual ~TraceBuffer();
+
+    // An empty ring in memory, or in a file at path
+    void Create(u32 capacity);
+    bool Create(const char* path, u32 capacity);
+
+    // Reads back a file written by Create
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const { return _header != nullptr; }
+    void Flush();
+
+    void Write(const TraceRecord& record)
+    {
+        _records[_next] = record;
+        if (++_next == _header->Capacity)
+        {
+            _next = 0;
+        }
+        _header->Count++;
+    }
+
+    // Records held, and the i'th oldest of them
+    u32 Size() const;
+    const TraceRecord& Get(u32 i) const;
+
+private:
+    void Attach(u8* data);
+
+private:
+    std::vector<u8> _memory;
+    MappedFile _file;
+
+    TraceHeader* _header;
+    TraceRecord* _records;
+    u32 _next;
+};
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer, single consumer triple buffer. The producer always
+// has a slot to write into and the consumer always has the newest complete slot
+// to read, so neither side ever waits on the other. Frames the consumer doesn't
+// get to in time are silently replaced.
+template <typename T>
+class TripleBuffer
+{
+private:
+    static const u32 INDEX_MASK = 0x3;
+    static const u32 FRESH = 0x4;
+
+public:
+    TripleBuffer()
+        : _slots()
+        , _back(0)
+        , _middle(1)
+        , _front(2)
+    {
+    }
+
+    // Producer side
+    T& Back() { return _slots[_back]; }
+    void Publish()
+    {
+        _back = _middle.exchange(_back | FRESH) & INDEX_MASK;
+    }
+
+    // True if a slot was published that the consumer hasn't taken yet
+    bool HasFresh() const { return (_middle.load() & FRESH) != 0; }
+
+    // Consumer side. Returns true if Front changed.
+    bool Acquire()
+    {
+        if (!HasFresh())
+        {
+            return false;
+        }
+        _front = _middle.exchange(_front) & INDEX_MASK;
+        return true;
+    }
+    const T& Front() const { return _slots[_front]; }
+
+private:
+    T _slots[3];
+    u32 _back;
+    std::atomic<u32> _middle;
+    u32 _front;
+};
\ No newline at end of file
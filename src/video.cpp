@@ -3,13 +3,14 @@
 #include "gameboy.h"
 #include "cpu.h"
 #include "memory.h"
+#include "state.h"
 
 const u32 Video::CYCLES_PER_SCANLINE = 456;
 const u32 Video::SCANLINES_PER_FRAME = 154;
 const u32 Video::VBLANK_SCANLINE = 144;
 const u16 Video::VRAM_MASK = 0x1FFF;
 
-u8 Video::Tile::GetPixelData(u8 x, u8 y)
+u8 Video::Tile::GetPixelData(u8 x, u8 y) const
 {
     u8 tileLo = _bytes[y * 2];
     u8 tileHi = _bytes[(y * 2) + 1];
@@ -68,6 +69,11 @@ u8& Video::Oam::operator[](int i)
     return _mem.bytes[i];
 }
 
+void Video::Oam::Serialize(StateStream& state)
+{
+    state.Value(_mem.bytes);
+}
+
 void Video::Oam::ProcessSpritesForLine(u8 y)
 {
     NumSpritesOnLine = 0;
@@ -88,10 +94,12 @@ void Video::Oam::ProcessSpritesForLine(u8 y)
 Video::Video(const Gameboy& gameboy)
     : _gameboy(gameboy)
     , _cpu(nullptr)
-    , _vram(0)
     , _cycles(0)
     , _vblankThisStep(false)
+    , _statMode(0)
+    , _xLatch(0)
 {
+    memset(_linesDrawn, 0, sizeof(_linesDrawn));
 }
 
 Video::~Video()
@@ -103,9 +111,8 @@ void Video::Init()
 {
     _cpu = _gameboy._cpu;
 
-    _vram.clear();
-    _vram.resize(0x2000, 0);
-    _spriteTiles = (Tile*)&_vram[0x8000 & VRAM_MASK];
+    _vram.Resize(0x2000, 0);
+    _spriteTiles = 0x8000 & VRAM_MASK;
 
     _oam.Init();
 
@@ -129,18 +136,44 @@ void Video::UnInit()
     _cpu = nullptr;
 }
 
+void Video::Serialize(StateStream& state)
+{
+    state.Memory(_vram);
+    _oam.Serialize(state);
+    state.Value(_scanlineCycles);
+    state.Value(_vblankThisStep);
+    state.Value(_lcdc);
+    state.Value(_stat);
+    state.Value(_bgp);
+    state.Value(_obp);
+    state.Value(_ly);
+    state.Value(_statMode);
+    state.Value(SCY);
+    state.Value(SCX);
+    state.Value(LYC);
+    state.Value(WY);
+    state.Value(WX);
+    state.Value(_cycles);
+    state.Value(_xLatch);
+
+    if (state.IsLoading())
+    {
+        DecodeLCDC();
+    }
+}
+
 u8 Video::LoadVRam(u16 addr)
 {
     Step();
     addr &= VRAM_MASK;
-    return _vram[addr];
+    return _vram.Load(addr);
 }
 
 void Video::StoreVRam(u16 addr, u8 val)
 {
     Step();
     addr &= VRAM_MASK;
-    _vram[addr] = val;
+    _vram.Store(addr, val);
 }
 
 u8 Video::LoadOAM(u16 addr)
@@ -167,21 +200,28 @@ void Video::WriteLCDC(u8 val)
 {
     Step();
     _lcdc = val;
+    DecodeLCDC();
 
-    _screenEnabled = (val & (1 << 7)) != 0;
     if (!_screenEnabled) _ly = 0;
+}
 
-    _bgTileMap = (val & (1 << 3)) == 0 ? &_vram[0x9800 & VRAM_MASK] : &_vram[0x9c00 & VRAM_MASK];
-    _windowTileMap = (val & (1 << 6)) == 0 ? &_vram[0x9800 & VRAM_MASK] : &_vram[0x9c00 & VRAM_MASK];
+void Video::DecodeLCDC()
+{
+    u8 val = _lcdc;
+
+    _screenEnabled = (val & (1 << 7)) != 0;
+
+    _bgTileMap = (val & (1 << 3)) == 0 ? (0x9800 & VRAM_MASK) : (0x9c00 & VRAM_MASK);
+    _windowTileMap = (val & (1 << 6)) == 0 ? (0x9800 & VRAM_MASK) : (0x9c00 & VRAM_MASK);
 
     if ((val & (1 << 4)) != 0)
     {
-        _bgTiles = (Tile*)&_vram[0x8000 & VRAM_MASK];
+        _bgTiles = 0x8000 & VRAM_MASK;
         _tileIndexIsSigned = false;
     }
     else
     {
-        _bgTiles = (Tile*)&_vram[0x9000 & VRAM_MASK];
+        _bgTiles = 0x9000 & VRAM_MASK;
         _tileIndexIsSigned = true;
     }
 
@@ -252,11 +292,15 @@ u8 Video::LY()
 
 bool Video::Step()
 {
+    PERF_COUNT(VIDEO_STEPS);
+    PERF_TIME(VIDEO_STEP_TICKS);
+
     int cycles = _cpu->GetCycles() - _cycles;
     _cycles = _cpu->GetCycles();
 
     if (cycles == 0)
     {
+        PERF_COUNT(VIDEO_IDLE_STEPS);
         return _vblankThisStep;
     }
 
@@ -280,6 +324,7 @@ bool Video::Step()
             {
                 _cpu->RequestInterrupt(Cpu::InterruptType::V_BLANK);
                 _vblankThisStep = true;
+                BlankUndrawnLines();
                 _statMode = 1;
             }
             else if (_ly < VBLANK_SCANLINE)
@@ -362,6 +407,7 @@ bool Video::Step()
 
         if (_statMode != oldStatMode)
         {
+            PERF_COUNT(VIDEO_MODE_CHANGES);
             DoStatModeInterrupt();
         }
     }
@@ -382,9 +428,26 @@ void Video::DoStatModeInterrupt()
 
 void Video::DoScanline()
 {
+    if (_screen.Pixels == nullptr)
+    {
+        return;
+    }
+
+    // lines skipped earlier in a downsampled block (LCD off) count as blank
+    static const u8 BLANK[ScreenBuffer::WIDTH] = { 0 };
+    for (u32 y = _ly - _ly % _screen.Scale; y < _ly; y++)
+    {
+        if (!_linesDrawn[y])
+        {
+            _screen.WriteLine(y, BLANK);
+            _linesDrawn[y] = true;
+        }
+    }
+
     _oam.ProcessSpritesForLine(_ly);
 
-    u32 screenOffset = _ly * 160;
+    // shades for the line are converted to the screen's format in one go
+    u8 line[ScreenBuffer::WIDTH];
     for (u8 i = 0; i < 160; i++)
     {
         u8 bgPaletteIndex = 0;
@@ -414,10 +477,38 @@ void Video::DoScanline()
             }
         }
 
-        _screen[screenOffset + i] = color;
+        line[i] = color;
+    }
+
+    _screen.WriteLine(_ly, line);
+    _linesDrawn[_ly] = true;
+}
+
+// Lines that were never rendered this frame (LCD off) show shade 0. A
+// downsampled row is only written with the last line of its block, so rows
+// whose last line wasn't drawn are filled directly.
+void Video::BlankUndrawnLines()
+{
+    if (_screen.Pixels == nullptr)
+    {
+        return;
+    }
+
+    for (u32 row = 0; row < _screen.Height(); row++)
+    {
+        if (!_linesDrawn[(row + 1) * _screen.Scale - 1])
+        {
+            _screen.BlankRow(row);
+        }
     }
 }
 
+// Tiles are 16 byte aligned so never straddle a VRAM page
+const Video::Tile* Video::GetTile(u16 offset) const
+{
+    return (const Tile*)(_vram.ReadPage(offset >> PagedMemory::PAGE_SHIFT) + (offset & PagedMemory::PAGE_MASK));
+}
+
 u8 Video::GetBackgroundPixel(u32 x, u32 y)
 {
     x += _xLatch; // _xLatch;
@@ -425,16 +516,16 @@ u8 Video::GetBackgroundPixel(u32 x, u32 y)
     y += (u32)SCY;
     y %= 256;
 
-    u8 unsignedTileNum = _bgTileMap[((y / 8) * 32) + (x / 8)];
+    u8 unsignedTileNum = _vram.Load(_bgTileMap + ((y / 8) * 32) + (x / 8));
 
-    Tile* tile;
+    const Tile* tile;
     if (_tileIndexIsSigned)
     {
-        tile = &_bgTiles[(i8)unsignedTileNum];
+        tile = GetTile((u16)(_bgTiles + (i8)unsignedTileNum * (i32)sizeof(Tile)));
     }
     else
     {
-        tile = &_bgTiles[unsignedTileNum];
+        tile = GetTile((u16)(_bgTiles + unsignedTileNum * sizeof(Tile)));
     }
 
     u8 tileX = x % 8;
@@ -471,7 +562,7 @@ bool Video::GetSpritePixel(u8 x, u8 y, u8& sprColor, bool& sprHasPriority)
             }
         }
 
-        Tile* tile = &_spriteTiles[tileNumber];
+        const Tile* tile = GetTile((u16)(_spriteTiles + tileNumber * sizeof(Tile)));
 
         u8 tileY = (y - spr->Y()) % 8;
         if (spr->FlipY()) tileY = 7 - tileY;
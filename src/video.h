@@ -1,8 +1,11 @@
 #pragma once
 
 #include "cpu.h"
+#include "pagedmemory.h"
+#include "screenbuffer.h"
 
 class Gameboy;
+class StateStream;
 
 class Video
 {
@@ -21,7 +24,7 @@ private:
         Tile() { };
 
     public:
-        u8 GetPixelData(u8 x, u8 y);
+        u8 GetPixelData(u8 x, u8 y) const;
 
     private:
         u8 _bytes[16];
@@ -60,6 +63,7 @@ private:
         u8 operator[](int i) const;
         u8& operator[](int i);
         void ProcessSpritesForLine(u8 y);
+        void Serialize(StateStream& state);
 
     public:
         Sprite* SpritesOnLine[10];
@@ -81,6 +85,8 @@ public:
     void Init();
     void UnInit();
 
+    void Serialize(StateStream& state);
+
     // I/O
 public:
     u8 LoadVRam(u16 addr);
@@ -101,15 +107,25 @@ public:
     u8 ReadOBP1();
     void WriteOBP1(u8 val);
     u8 LY();
+    // LY as of the last Step, without catching up
+    u8 Line() const { return _ly; }
     u8 LYC;
     u8 WY;
     u8 WX;
 
     bool Step();
 
-    void SetScreen(u8 screen[])
+    // Starts a frame in screen. Lines it doesn't draw are blanked at vblank
+    void SetScreen(const ScreenBuffer& screen)
     {
         _screen = screen;
+        memset(_linesDrawn, 0, sizeof(_linesDrawn));
+    }
+
+    // Carries on a frame into screen without losing a partly summed block row
+    void ResumeScreen(const ScreenBuffer& screen)
+    {
+        _screen.Retarget(screen);
     }
 
     void BeforeFrame()
@@ -119,11 +135,14 @@ public:
     }
 
 private:
+    void DecodeLCDC();
     void DoStatModeInterrupt();
 
     // Rendering
 private:
     void DoScanline();
+    void BlankUndrawnLines();
+    const Tile* GetTile(u16 offset) const;
     u8 GetBackgroundPixel(u32 x, u32 y);
     u8 GetWindowPixel(u8 x, u8 y);
     bool GetSpritePixel(u8 x, u8 y, u8& sprColor, bool& sprHasPriority);
@@ -132,7 +151,7 @@ private:
     const Gameboy& _gameboy;
     std::shared_ptr<Cpu> _cpu;
 
-    std::vector<u8> _vram;
+    PagedMemory _vram;
     Oam _oam;
     u32 _scanlineCycles;
 
@@ -150,10 +169,11 @@ private:
 
     // Rendering
 private:
-    Tile* _bgTiles;
-    Tile* _spriteTiles;
-    u8* _bgTileMap;
-    u8* _windowTileMap;
+    // Offsets into VRAM, which is paged
+    u16 _bgTiles;
+    u16 _spriteTiles;
+    u16 _bgTileMap;
+    u16 _windowTileMap;
 
     bool _tileIndexIsSigned;
 
@@ -164,7 +184,8 @@ private:
 
     int _cycles;
 
-    u8* _screen;
+    ScreenBuffer _screen;
+    bool _linesDrawn[ScreenBuffer::HEIGHT];
 
     u8 _xLatch;
 };
\ No newline at end of file